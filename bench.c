@@ -0,0 +1,348 @@
+//
+// bench.c
+//
+// Copyright (c) 2024 Brian Khuu
+// MIT licensed
+//
+
+// Throughput benchmark. Generates synthetic multipart bodies in memory and times each parser api over them.
+// Prints one JSON object per line (case, api, build, MB/s, ns/byte, events/byte) so results can be collected per commit.
+//
+// Usage: bench [--large-mb N] [--case NAME]
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "minimal_multipart_parser.h"
+#define TEST_SUPPORT_PRNG_SEED 2463534242u
+#include "test_support.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef BENCH_BUILD
+#define BENCH_BUILD "default"
+#endif
+
+#ifndef BENCH_COMMIT
+#define BENCH_COMMIT "unknown"
+#endif
+
+#define BENCH_BOUNDARY "----BenchBoundary7MA4YWxkTrZu0gW"
+#define BENCH_CONTENT_TYPE "multipart/form-data; boundary=" BENCH_BOUNDARY
+#define BENCH_CHUNK_SIZE (64 * 1024)
+#define BENCH_MIN_SECONDS (0.5)
+
+typedef struct Body
+{
+    char *data;
+    size_t size;
+    size_t capacity;
+    size_t payload_size; // Sum of all part bodies, used to check the parser got every byte
+} Body;
+
+typedef struct Result
+{
+    size_t payload_size;
+    size_t events;
+} Result;
+
+static void body_append(Body *body, const char *data, const size_t size)
+{
+    if (body->size + size > body->capacity)
+    {
+        body->capacity = (body->size + size) * 2;
+        body->data = realloc(body->data, body->capacity);
+        if (!body->data)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(2);
+        }
+    }
+    memcpy(&body->data[body->size], data, size);
+    body->size += size;
+}
+
+static void body_append_string(Body *body, const char *string) { body_append(body, string, strlen(string)); }
+
+static void body_part_begin(Body *body, const char *name, const char *filename)
+{
+    char header[256];
+    body_append_string(body, "--" BENCH_BOUNDARY "\r\n");
+    if (filename)
+    {
+        snprintf(header, sizeof(header), "Content-Disposition: form-data; name=\"%s\"; filename=\"%s\"\r\nContent-Type: application/octet-stream\r\n\r\n", name, filename);
+    }
+    else
+    {
+        snprintf(header, sizeof(header), "Content-Disposition: form-data; name=\"%s\"\r\n\r\n", name);
+    }
+    body_append_string(body, header);
+}
+
+static void body_part_end(Body *body) { body_append_string(body, "\r\n"); }
+
+static void body_close(Body *body) { body_append_string(body, "--" BENCH_BOUNDARY "--\r\n"); }
+
+// Random binary payload. Cannot contain the delimiter by chance as it never has a '\r' followed by '\n'
+static void body_append_random(Body *body, size_t size)
+{
+    char block[4096];
+    body->payload_size += size;
+    while (size > 0)
+    {
+        const size_t block_size = size < sizeof(block) ? size : sizeof(block);
+        for (size_t i = 0; i < block_size; i++)
+        {
+            block[i] = (char)prng();
+            if (i > 0 && block[i - 1] == '\r' && block[i] == '\n')
+            {
+                block[i] = 'n';
+            }
+        }
+        if (block[0] == '\n' && body->size > 0 && body->data[body->size - 1] == '\r')
+        {
+            block[0] = 'n';
+        }
+        body_append(body, block, block_size);
+        size -= block_size;
+    }
+}
+
+static void generate_tiny_fields(Body *body)
+{
+    // Typical form post, lots of short text fields
+    char name[32];
+    char value[32];
+    for (unsigned int i = 0; i < 20000; i++)
+    {
+        snprintf(name, sizeof(name), "field%u", i);
+        snprintf(value, sizeof(value), "value %u", prng() % 100000);
+        body_part_begin(body, name, NULL);
+        body_append_string(body, value);
+        body->payload_size += strlen(value);
+        body_part_end(body);
+    }
+    body_close(body);
+}
+
+static void generate_large_file(Body *body, const size_t size)
+{
+    body_part_begin(body, "firmware", "firmware.bin");
+    body_append_random(body, size);
+    body_part_end(body);
+    body_close(body);
+}
+
+static void generate_near_misses(Body *body, const size_t size)
+{
+    // Payload made of `\r\n--` followed by a random amount of the boundary, always broken off before the full delimiter
+    const char delimiter[] = "\r\n--" BENCH_BOUNDARY;
+    body_part_begin(body, "adversarial", "adversarial.bin");
+    const size_t start = body->size;
+    while (body->size - start < size)
+    {
+        const size_t match = 1 + prng() % (sizeof(delimiter) - 2);
+        body_append(body, delimiter, match);
+        body_append_string(body, "x");
+    }
+    body->payload_size += body->size - start;
+    body_part_end(body);
+    body_close(body);
+}
+
+static void generate_many_parts(Body *body)
+{
+    char name[32];
+    for (unsigned int i = 0; i < 20000; i++)
+    {
+        snprintf(name, sizeof(name), "file%u", i);
+        body_part_begin(body, name, name);
+        body_append_random(body, 512 + prng() % 1024);
+        body_part_end(body);
+    }
+    body_close(body);
+}
+
+static MinimalMultipartParserContext bench_context(void)
+{
+    MinimalMultipartParserContext context = {0};
+    if (!minimal_multipart_parser_init_from_content_type(&context, BENCH_CONTENT_TYPE, strlen(BENCH_CONTENT_TYPE)))
+    {
+        fprintf(stderr, "bad content type\n");
+        exit(2);
+    }
+    return context;
+}
+
+static Result run_per_char(const Body *body)
+{
+    Result result = {0};
+    MinimalMultipartParserContext context = bench_context();
+    for (size_t i = 0; i < body->size; i++)
+    {
+        const MultipartParserEvent event = minimal_multipart_parser_process(&context, body->data[i]);
+        if (event != MultipartParserEvent_None)
+        {
+            result.events++;
+            if (event == MultipartParserEvent_DataBufferAvailable)
+            {
+                result.payload_size += minimal_multipart_parser_get_data_size(&context);
+            }
+        }
+    }
+    return result;
+}
+
+static Result run_buffer(const Body *body)
+{
+    Result result = {0};
+    MinimalMultipartParserContext context = bench_context();
+    for (size_t offset = 0; offset < body->size;)
+    {
+        const size_t remaining = body->size - offset;
+        const size_t chunk_size = remaining < BENCH_CHUNK_SIZE ? remaining : BENCH_CHUNK_SIZE;
+        const size_t chunk_end = offset + chunk_size;
+        while (offset < chunk_end)
+        {
+            size_t consumed = 0;
+            const MultipartParserEvent event = minimal_multipart_parser_process_buffer(&context, &body->data[offset], chunk_end - offset, &consumed);
+            offset += consumed;
+            if (event != MultipartParserEvent_None)
+            {
+                result.events++;
+                if (event == MultipartParserEvent_DataBufferAvailable)
+                {
+                    result.payload_size += minimal_multipart_parser_get_data_size(&context);
+                }
+            }
+        }
+    }
+    return result;
+}
+
+static void sink_on_part_begin(void *user_data, const MinimalMultipartParserContext *context) { ((Result *)user_data)->events++; }
+
+static void sink_on_data(void *user_data, const char *data, const size_t size)
+{
+    Result *result = user_data;
+    result->events++;
+    result->payload_size += size;
+}
+
+static void sink_on_part_end(void *user_data, const MinimalMultipartParserContext *context) { ((Result *)user_data)->events++; }
+
+static Result run_sink(const Body *body)
+{
+    static char scratch[BENCH_CHUNK_SIZE];
+    Result result = {0};
+    MinimalMultipartParserSink sink = {sink_on_part_begin, sink_on_data, sink_on_part_end, &result, scratch, sizeof(scratch), 0};
+    MinimalMultipartParserContext context = bench_context();
+    for (size_t offset = 0; offset < body->size;)
+    {
+        const size_t remaining = body->size - offset;
+        offset += minimal_multipart_parser_process_sink(&context, &sink, &body->data[offset], remaining < BENCH_CHUNK_SIZE ? remaining : BENCH_CHUNK_SIZE);
+    }
+    return result;
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static bool bench(const char *case_name, const Body *body, const char *api_name, Result (*run)(const Body *))
+{
+    // Repeat until enough time has passed to even out timer resolution and noise
+    unsigned int iterations = 0;
+    Result result = {0};
+    const double start = now_seconds();
+    double elapsed = 0;
+    do
+    {
+        result = run(body);
+        iterations++;
+        elapsed = now_seconds() - start;
+    } while (elapsed < BENCH_MIN_SECONDS);
+
+    if (result.payload_size != body->payload_size)
+    {
+        fprintf(stderr, "%s/%s: parser returned %zu payload bytes, expected %zu\n", case_name, api_name, result.payload_size, body->payload_size);
+        return false;
+    }
+
+    const double bytes = (double)body->size * iterations;
+    printf("{\"commit\":\"%s\",\"build\":\"%s\",\"case\":\"%s\",\"api\":\"%s\",\"bytes\":%zu,\"iterations\":%u,\"seconds\":%.6f,\"mb_per_s\":%.2f,\"ns_per_byte\":%.4f,\"events_per_byte\":%.6f}\n",
+           BENCH_COMMIT, BENCH_BUILD, case_name, api_name, body->size, iterations, elapsed, bytes / elapsed / 1e6, elapsed * 1e9 / bytes, (double)result.events / (double)body->size);
+    fflush(stdout);
+    return true;
+}
+
+static bool bench_case(const char *case_name, const Body *body)
+{
+    bool passed = true;
+    passed &= bench(case_name, body, "per_char", run_per_char);
+    passed &= bench(case_name, body, "buffer", run_buffer);
+    passed &= bench(case_name, body, "sink", run_sink);
+    return passed;
+}
+
+int main(int argc, char **argv)
+{
+    size_t large_mb = 1024;
+    const char *only_case = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--large-mb") == 0 && i + 1 < argc)
+        {
+            large_mb = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--case") == 0 && i + 1 < argc)
+        {
+            only_case = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [--large-mb N] [--case tiny_fields|large_file|near_misses|many_parts]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    bool passed = true;
+    if (!only_case || strcmp(only_case, "tiny_fields") == 0)
+    {
+        Body body = {0};
+        generate_tiny_fields(&body);
+        passed &= bench_case("tiny_fields", &body);
+        free(body.data);
+    }
+
+    if (!only_case || strcmp(only_case, "large_file") == 0)
+    {
+        Body body = {0};
+        generate_large_file(&body, large_mb * 1024 * 1024);
+        passed &= bench_case("large_file", &body);
+        free(body.data);
+    }
+
+    if (!only_case || strcmp(only_case, "near_misses") == 0)
+    {
+        Body body = {0};
+        generate_near_misses(&body, 64 * 1024 * 1024);
+        passed &= bench_case("near_misses", &body);
+        free(body.data);
+    }
+
+    if (!only_case || strcmp(only_case, "many_parts") == 0)
+    {
+        Body body = {0};
+        generate_many_parts(&body);
+        passed &= bench_case("many_parts", &body);
+        free(body.data);
+    }
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,568 @@
+//
+// fuzz_parser.c
+//
+// Copyright (c) 2024 Brian Khuu
+// MIT licensed
+//
+
+// Differential fuzz harness. Each input is run through the per char api, taken as the reference, then through the chunk api
+// split at every possible offset (or a sample of them for large inputs) and through the sink api, and any difference in the
+// events, part headers or data that come out is a failure. The delimiter search must also stay linear: the bytes it inspects,
+// from the stats counters, are checked against the input size so a search that goes quadratic on some run of `\r\n--` is caught.
+// The library build picks the engine under test (scalar, vectorised or computed goto), see `make fuzz`.
+//
+// The first input byte picks the mode (bit 0: boundary given up front instead of found in the body), the rest is the body.
+//
+// With -DFUZZ_LIBFUZZER only LLVMFuzzerTestOneInput() is built, for libFuzzer or AFL++ in libFuzzer mode. Otherwise:
+//   fuzz_parser [--iterations N] [--seed S] [--artifact PATH] [FILE...]
+// runs each FILE once (corpus replay, or plain AFL with `afl-fuzz -i in -o out -- ./fuzz_parser @@`), or else N generated bodies
+// dense in delimiter near misses. A failing input is written to PATH (fuzz_failure.bin by default). Prints one JSON line at the end.
+
+#include "minimal_multipart_parser.h"
+#define TEST_SUPPORT_PRNG_SEED 2463534242u
+#include "test_support.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef MINIMAL_MULTIPART_PARSER_ENABLE_STATS
+#error "Build with -DMINIMAL_MULTIPART_PARSER_ENABLE_STATS, the search cost check needs its counters"
+#endif
+
+#ifndef FUZZ_BUILD
+#define FUZZ_BUILD "default"
+#endif
+
+#ifndef FUZZ_COMMIT
+#define FUZZ_COMMIT "unknown"
+#endif
+
+#define FUZZ_BOUNDARY "AaB03x"
+#define FUZZ_MAX_INPUT (64 * 1024)
+
+// Inputs up to this size are split at every offset, larger ones at a sample of offsets
+#define FUZZ_EVERY_SPLIT_MAX (1024)
+#define FUZZ_SAMPLED_SPLITS (64)
+
+// Bound on bytes inspected by the whole parse. The constant covers delimiter sized work at chunk ends.
+#define FUZZ_MAX_INSPECTED(size) (4 * (size) + 256)
+
+typedef struct Trace
+{
+    char *data;
+    size_t size;
+    size_t capacity;
+} Trace;
+
+// What one run produced. `events` has one letter per event, with data events merged as the chunking decides how data is split up.
+// `parts` is the same run as the sink api sees it: part headers, data and part ends only.
+typedef struct Run
+{
+    Trace events;
+    Trace parts;
+    Trace data;
+    bool last_was_data;
+    unsigned int parts_completed;
+    bool completed;
+    bool limit_exceeded;
+    uint64_t inspected;
+} Run;
+
+static void trace_add(Trace *trace, const char *data, const size_t size)
+{
+    if (trace->size + size > trace->capacity)
+    {
+        trace->capacity = (trace->size + size) * 2 + 64;
+        trace->data = realloc(trace->data, trace->capacity);
+        if (!trace->data)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(2);
+        }
+    }
+    memcpy(&trace->data[trace->size], data, size);
+    trace->size += size;
+}
+
+static void trace_string(Trace *trace, const char *string)
+{
+    // Length first, so headers cannot run into each other
+    const unsigned char size = (unsigned char)strlen(string);
+    trace_add(trace, (const char *)&size, 1);
+    trace_add(trace, string, size);
+}
+
+static void trace_part_begin(Trace *trace, const MinimalMultipartParserContext *context)
+{
+    trace_add(trace, "B", 1);
+    trace_string(trace, minimal_multipart_parser_get_part_name(context));
+    trace_string(trace, minimal_multipart_parser_get_part_filename(context));
+    trace_string(trace, minimal_multipart_parser_get_part_content_type(context));
+}
+
+static void run_reset(Run *run)
+{
+    run->events.size = 0;
+    run->parts.size = 0;
+    run->data.size = 0;
+    run->last_was_data = false;
+}
+
+static void run_event(Run *run, const MinimalMultipartParserContext *context, const MultipartParserEvent event)
+{
+    if (event == MultipartParserEvent_None)
+    {
+        return;
+    }
+
+    if (event == MultipartParserEvent_DataBufferAvailable)
+    {
+        if (!run->last_was_data)
+        {
+            trace_add(&run->events, "D", 1);
+        }
+        run->last_was_data = true;
+        trace_add(&run->data, minimal_multipart_parser_get_data_buffer(context), minimal_multipart_parser_get_data_size(context));
+        return;
+    }
+
+    const char letter = (char)('a' + event);
+    run->last_was_data = false;
+    trace_add(&run->events, &letter, 1);
+    if (event == MultipartParserEvent_FileStreamStarting)
+    {
+        trace_part_begin(&run->events, context);
+        trace_part_begin(&run->parts, context);
+    }
+    else if (event == MultipartParserEvent_DataStreamCompleted)
+    {
+        trace_add(&run->parts, "E", 1);
+    }
+}
+
+static void run_finish(Run *run, const MinimalMultipartParserContext *context)
+{
+    run->parts_completed = minimal_multipart_parser_get_parts_completed(context);
+    run->completed = minimal_multipart_parser_is_multipart_completed(context);
+    run->limit_exceeded = minimal_multipart_parser_is_limit_exceeded(context);
+    run->inspected = minimal_multipart_parser_get_stats(context)->bytes_inspected;
+}
+
+static void context_start(MinimalMultipartParserContext *context, const bool preset)
+{
+    *context = (MinimalMultipartParserContext){0};
+    if (preset)
+    {
+        minimal_multipart_parser_init_with_boundary(context, FUZZ_BOUNDARY, strlen(FUZZ_BOUNDARY));
+    }
+}
+
+static void run_per_char(Run *run, const bool preset, const char *body, const size_t size)
+{
+    MinimalMultipartParserContext context;
+    context_start(&context, preset);
+    run_reset(run);
+    for (size_t i = 0; i < size; i++)
+    {
+        run_event(run, &context, minimal_multipart_parser_process(&context, body[i]));
+    }
+    run_finish(run, &context);
+}
+
+// Chunk api with the body cut at each offset in `splits` (ascending)
+static void run_chunks(Run *run, const bool preset, const char *body, const size_t size, const size_t *splits, const unsigned int split_count)
+{
+    MinimalMultipartParserContext context;
+    context_start(&context, preset);
+    run_reset(run);
+    size_t start = 0;
+    for (unsigned int chunk = 0; chunk <= split_count; chunk++)
+    {
+        const size_t end = (chunk < split_count) ? splits[chunk] : size;
+        while (start < end)
+        {
+            size_t consumed = 0;
+            const MultipartParserEvent event = minimal_multipart_parser_process_buffer(&context, &body[start], end - start, &consumed);
+            if (consumed == 0 && event == MultipartParserEvent_None)
+            {
+                fprintf(stderr, "process_buffer() made no progress at offset %zu\n", start);
+                abort();
+            }
+            start += consumed;
+            run_event(run, &context, event);
+        }
+    }
+    run_finish(run, &context);
+}
+
+static void sink_part_begin(void *user_data, const MinimalMultipartParserContext *context) { trace_part_begin(&((Run *)user_data)->parts, context); }
+
+static void sink_data(void *user_data, const char *data, const size_t size) { trace_add(&((Run *)user_data)->data, data, size); }
+
+static void sink_part_end(void *user_data, const MinimalMultipartParserContext *context) { trace_add(&((Run *)user_data)->parts, "E", 1); }
+
+// Sink api in chunks of random size, gathering into a scratch buffer of random size
+static void run_sink(Run *run, const bool preset, const bool decode, const char *body, const size_t size, const size_t max_chunk)
+{
+    char scratch[256];
+    MinimalMultipartParserSink sink = {sink_part_begin, sink_data, sink_part_end, run, scratch, prng() % sizeof(scratch), 0, decode};
+    MinimalMultipartParserContext context;
+    context_start(&context, preset);
+    run_reset(run);
+    for (size_t offset = 0; offset < size;)
+    {
+        const size_t chunk = 1 + prng() % max_chunk;
+        const size_t remaining = size - offset;
+        const size_t used = minimal_multipart_parser_process_sink(&context, &sink, &body[offset], chunk < remaining ? chunk : remaining);
+        offset += used;
+        if (minimal_multipart_parser_is_limit_exceeded(&context))
+        {
+            break;
+        }
+    }
+    minimal_multipart_parser_sink_flush(&sink);
+    run_finish(run, &context);
+}
+
+static bool trace_equal(const Trace *a, const Trace *b) { return a->size == b->size && (a->size == 0 || memcmp(a->data, b->data, a->size) == 0); }
+
+static bool run_equal(const Run *reference, const Run *run, const bool events)
+{
+    return (!events || trace_equal(&reference->events, &run->events)) && trace_equal(&reference->parts, &run->parts) && trace_equal(&reference->data, &run->data) &&
+           reference->parts_completed == run->parts_completed && reference->completed == run->completed && reference->limit_exceeded == run->limit_exceeded;
+}
+
+typedef struct Totals
+{
+    unsigned long long inputs;
+    unsigned long long bytes;
+    unsigned long long runs;
+    double worst_inspected_per_byte; // Over inputs of at least 1 KB, smaller ones are dominated by the constant
+} Totals;
+
+static Totals totals;
+static char failure_detail[160];
+
+static bool fail(const char *what, const size_t detail)
+{
+    snprintf(failure_detail, sizeof(failure_detail), "%s (%zu)", what, detail);
+    return false;
+}
+
+static bool check_inspected(const Run *run, const size_t size)
+{
+    if (run->inspected > FUZZ_MAX_INSPECTED(size))
+    {
+        return fail("delimiter search inspected too many bytes", (size_t)run->inspected);
+    }
+    if (size >= 1024 && (double)run->inspected / (double)size > totals.worst_inspected_per_byte)
+    {
+        totals.worst_inspected_per_byte = (double)run->inspected / (double)size;
+    }
+    return true;
+}
+
+// Returns false with `failure_detail` set if any api disagrees with the per char api on this input
+static bool check_input(const unsigned char *input, const size_t input_size)
+{
+    if (input_size == 0 || input_size > FUZZ_MAX_INPUT)
+    {
+        return true;
+    }
+    const bool preset = (input[0] & 1) != 0;
+    const char *body = (const char *)&input[1];
+    const size_t size = input_size - 1;
+
+    static Run reference;
+    static Run run;
+    static size_t splits[FUZZ_MAX_INPUT];
+    totals.inputs++;
+    totals.bytes += size;
+
+    run_per_char(&reference, preset, body, size);
+    if (!check_inspected(&reference, size))
+    {
+        return false;
+    }
+
+    // Whole body as one chunk, then cut in two at every offset, then in many pieces of a few fixed sizes
+    run_chunks(&run, preset, body, size, splits, 0);
+    totals.runs++;
+    if (!run_equal(&reference, &run, true))
+    {
+        return fail("chunk api differs, whole body", size);
+    }
+    if (!check_inspected(&run, size))
+    {
+        return false;
+    }
+
+    const unsigned int split_runs = size <= FUZZ_EVERY_SPLIT_MAX ? (unsigned int)size : FUZZ_SAMPLED_SPLITS;
+    for (unsigned int i = 1; i < split_runs; i++)
+    {
+        splits[0] = size <= FUZZ_EVERY_SPLIT_MAX ? i : 1 + prng() % (size - 1);
+        run_chunks(&run, preset, body, size, splits, 1);
+        totals.runs++;
+        if (!run_equal(&reference, &run, true))
+        {
+            return fail("chunk api differs, split at", splits[0]);
+        }
+        if (!check_inspected(&run, size))
+        {
+            return false;
+        }
+    }
+
+    const size_t chunk_sizes[] = {1, 2, 3, 7, 13, 64};
+    for (unsigned int i = 0; i < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); i++)
+    {
+        unsigned int split_count = 0;
+        for (size_t offset = chunk_sizes[i]; offset < size; offset += chunk_sizes[i])
+        {
+            splits[split_count++] = offset;
+        }
+        run_chunks(&run, preset, body, size, splits, split_count);
+        totals.runs++;
+        if (!run_equal(&reference, &run, true))
+        {
+            return fail("chunk api differs, chunks of", chunk_sizes[i]);
+        }
+        if (!check_inspected(&run, size))
+        {
+            return false;
+        }
+    }
+
+    // Sink api, which only sees parts and their data
+    const size_t max_chunks[] = {1, 16, FUZZ_MAX_INPUT};
+    for (unsigned int i = 0; i < sizeof(max_chunks) / sizeof(max_chunks[0]); i++)
+    {
+        run_sink(&run, preset, false, body, size, max_chunks[i]);
+        totals.runs++;
+        if (!run_equal(&reference, &run, false))
+        {
+            return fail("sink api differs, chunks up to", max_chunks[i]);
+        }
+    }
+
+    // Transfer decoding carries state across views, so however the body is chunked it must decode the same
+    run_sink(&reference, preset, true, body, size, FUZZ_MAX_INPUT);
+    for (unsigned int i = 0; i < 2; i++)
+    {
+        run_sink(&run, preset, true, body, size, max_chunks[i]);
+        totals.runs++;
+        if (!run_equal(&reference, &run, false))
+        {
+            return fail("decoding sink differs, chunks up to", max_chunks[i]);
+        }
+    }
+
+    // Stateless delimiter search against comparing at every offset
+    if (preset)
+    {
+        MinimalMultipartParserContext context;
+        context_start(&context, true);
+        const char delimiter[] = "\r\n--" FUZZ_BOUNDARY;
+        const size_t expected = naive_find(body, size, delimiter, sizeof(delimiter) - 1);
+        if (minimal_multipart_parser_find_delimiter(&context, body, size) != expected)
+        {
+            return fail("find_delimiter differs from naive search, expected", expected);
+        }
+    }
+    return true;
+}
+
+#ifdef FUZZ_LIBFUZZER
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if (!check_input(data, size))
+    {
+        fprintf(stderr, "%s\n", failure_detail);
+        abort();
+    }
+    return 0;
+}
+#else
+static size_t append(unsigned char *out, size_t size, const size_t capacity, const char *token)
+{
+    const size_t count = strlen(token);
+    if (size + count <= capacity)
+    {
+        memcpy(&out[size], token, count);
+        size += count;
+    }
+    return size;
+}
+
+// Pieces that make up a body, weighted towards delimiters and near misses of them
+static const char *const near_misses[] = {"\r\n--AaB03", "\r\n--AaB0", "\r\n--A", "\r\n--", "\r\n-", "\r\n", "\r", "\n", "-", "--"};
+static const char *const headers[] = {
+    "Content-Disposition: form-data; name=\"field\"\r\n",
+    "Content-Disposition: form-data; name=\"file\"; filename=\"a.bin\"\r\n",
+    "Content-Type: application/octet-stream\r\n",
+    "Content-Transfer-Encoding: base64\r\n",
+    "Content-Transfer-Encoding: quoted-printable\r\n",
+};
+static const char *const others[] = {
+    "\r\n--" FUZZ_BOUNDARY "\r\n", "\r\n--" FUZZ_BOUNDARY "--", "\r\n--" FUZZ_BOUNDARY, "--" FUZZ_BOUNDARY "\r\n", "\r\n\r\n", "aGVsbG8gd29ybGQ=", "=41=0D=0A=\r\n", "hello",
+};
+
+#define COUNT_OF(array) (sizeof(array) / sizeof((array)[0]))
+
+static const char *any_token(void)
+{
+    const unsigned int pick = prng() % (COUNT_OF(near_misses) + COUNT_OF(headers) + COUNT_OF(others));
+    if (pick < COUNT_OF(near_misses))
+    {
+        return near_misses[pick];
+    }
+    return (pick < COUNT_OF(near_misses) + COUNT_OF(headers)) ? headers[pick - COUNT_OF(near_misses)] : others[pick - COUNT_OF(near_misses) - COUNT_OF(headers)];
+}
+
+// Mostly well formed bodies with near misses in the part data, some token soup, and now and then a long run of one near miss
+static size_t generate(unsigned char *out, const size_t capacity)
+{
+    size_t size = 0;
+    out[size++] = (unsigned char)(prng() % 2);
+
+    const unsigned int kind = prng() % 8;
+    if (kind == 0)
+    {
+        // Token soup
+        const unsigned int count = prng() % 200;
+        for (unsigned int i = 0; i < count; i++)
+        {
+            size = append(out, size, capacity, any_token());
+        }
+        return size;
+    }
+
+    if (prng() % 2)
+    {
+        size = append(out, size, capacity, "preamble\r\n");
+    }
+    const unsigned int parts = prng() % 4;
+    for (unsigned int part = 0; part < parts; part++)
+    {
+        size = append(out, size, capacity, part == 0 && prng() % 2 ? "--" FUZZ_BOUNDARY "\r\n" : "\r\n--" FUZZ_BOUNDARY "\r\n");
+        const unsigned int header_count = prng() % 4;
+        for (unsigned int i = 0; i < header_count; i++)
+        {
+            size = append(out, size, capacity, headers[prng() % COUNT_OF(headers)]);
+        }
+        size = append(out, size, capacity, "\r\n");
+
+        if (kind == 1)
+        {
+            // Long run of one near miss, the worst case for the delimiter search
+            const char *near_miss = near_misses[prng() % COUNT_OF(near_misses)];
+            const size_t target = capacity / 2 + prng() % (capacity / 4 + 1);
+            while (size + strlen(near_miss) < target)
+            {
+                size = append(out, size, capacity, near_miss);
+            }
+            continue;
+        }
+
+        const unsigned int count = prng() % 40;
+        for (unsigned int i = 0; i < count; i++)
+        {
+            if (prng() % 3 == 0 && size < capacity)
+            {
+                out[size++] = (unsigned char)prng();
+            }
+            else
+            {
+                size = append(out, size, capacity, prng() % 2 ? near_misses[prng() % COUNT_OF(near_misses)] : any_token());
+            }
+        }
+    }
+    if (prng() % 4)
+    {
+        size = append(out, size, capacity, "\r\n--" FUZZ_BOUNDARY "--\r\nepilogue");
+    }
+
+    // Cut short now and then
+    return (prng() % 8 == 0 && size > 1) ? 1 + prng() % (size - 1) : size;
+}
+
+static bool save_artifact(const char *path, const unsigned char *input, const size_t size)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file)
+    {
+        return false;
+    }
+    const bool written = fwrite(input, 1, size, file) == size;
+    return (fclose(file) == 0) && written;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long iterations = 500;
+    const char *artifact = "fuzz_failure.bin";
+    int first_file = argc;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+        {
+            iterations = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            prng_state = (unsigned int)strtoul(argv[++i], NULL, 10);
+            prng_state = prng_state ? prng_state : 1;
+        }
+        else if (strcmp(argv[i], "--artifact") == 0 && i + 1 < argc)
+        {
+            artifact = argv[++i];
+        }
+        else
+        {
+            first_file = i;
+            break;
+        }
+    }
+
+    static unsigned char input[FUZZ_MAX_INPUT + 1];
+    bool passed = true;
+    if (first_file < argc)
+    {
+        for (int i = first_file; i < argc && passed; i++)
+        {
+            FILE *file = fopen(argv[i], "rb");
+            if (!file)
+            {
+                fprintf(stderr, "cannot open %s\n", argv[i]);
+                return 2;
+            }
+            const size_t size = fread(input, 1, sizeof(input), file);
+            fclose(file);
+            passed = check_input(input, size);
+            if (!passed)
+            {
+                fprintf(stderr, "%s: %s\n", argv[i], failure_detail);
+            }
+        }
+    }
+    else
+    {
+        for (unsigned long i = 0; i < iterations && passed; i++)
+        {
+            const size_t capacity = (prng() % 16 == 0) ? FUZZ_MAX_INPUT : 1 + prng() % 800;
+            const size_t size = generate(input, capacity);
+            passed = check_input(input, size);
+            if (!passed)
+            {
+                fprintf(stderr, "input %lu: %s, saved to %s\n", i, failure_detail, save_artifact(artifact, input, size) ? artifact : "(could not save)");
+            }
+        }
+    }
+
+    printf("{\"build\":\"%s\",\"commit\":\"%s\",\"inputs\":%llu,\"bytes\":%llu,\"runs\":%llu,\"worst_inspected_per_byte\":%.3f,\"passed\":%s}\n", FUZZ_BUILD, FUZZ_COMMIT,
+           totals.inputs, totals.bytes, totals.runs, totals.worst_inspected_per_byte, passed ? "true" : "false");
+    return passed ? 0 : 1;
+}
+#endif
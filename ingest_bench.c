@@ -0,0 +1,514 @@
+//
+// ingest_bench.c
+//
+// Copyright (c) 2024 Brian Khuu
+// MIT licensed
+//
+
+// Loopback ingestion benchmark, and an example of driving the parser from a non-blocking epoll(7) event loop.
+// A client thread opens many connections at once and uploads the same multipart body on each. The server side (main thread)
+// reads every connection as data arrives and hands it to its own compact context from a pool through the sink api.
+//
+// The sink's downstream is a queue of limited size per connection that drains a little on every turn of the loop, standing in
+// for a slow disk or backend. When it is full the sink pauses, the connection stops being read (so TCP pushes back on the client),
+// and the rest of its last read is parsed once the queue has drained, carrying on from any partly matched delimiter.
+//
+// Prints one JSON object (aggregate MB/s, and per chunk latency from read to fully parsed) like bench.c, and fails if any
+// connection did not get exactly the parts and bytes that were sent. Linux only.
+//
+// Usage: ingest_bench [--connections N] [--body-kb N] [--downstream-kb N]
+
+#define _GNU_SOURCE
+
+#include "minimal_multipart_parser.h"
+#define TEST_SUPPORT_PRNG_SEED 2463534242u
+#include "test_support.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef MINIMAL_MULTIPART_PARSER_COMPACT_CONTEXT
+#error "ingest_bench is built against the compact context layout, see the makefile"
+#endif
+
+#ifndef BENCH_COMMIT
+#define BENCH_COMMIT "unknown"
+#endif
+
+#define INGEST_BOUNDARY "----IngestBoundary7MA4YWxkTrZu0gW"
+#define INGEST_CONTENT_TYPE "multipart/form-data; boundary=" INGEST_BOUNDARY
+#define READ_CHUNK_SIZE (16 * 1024)
+#define WRITE_CHUNK_SIZE (64 * 1024)
+#define EPOLL_BATCH (256)
+
+// What would be the HTTP request head, cut down to the Content-Type value on a line of its own in front of the body
+typedef struct Upload
+{
+    char *data;
+    size_t size;
+    size_t payload_size; // Sum of all part bodies
+    unsigned int parts;
+} Upload;
+
+typedef struct Server Server;
+
+typedef struct Connection
+{
+    Server *server;
+    int fd;
+    MinimalMultipartParserContext *context; // NULL until the request head is in
+    MinimalMultipartParserSink sink;
+
+    // Last read, of which `pending` bytes from `pending_offset` are still to be parsed after a pause
+    char buffer[READ_CHUNK_SIZE];
+    size_t pending_offset;
+    size_t pending;
+    double read_time;
+
+    size_t queued; // Bytes in the downstream queue, which pauses the sink once it holds `downstream_size`
+    bool paused;
+
+    size_t payload_size;
+    unsigned int parts;
+} Connection;
+
+struct Server
+{
+    int epoll_fd;
+    int listen_fd;
+    MinimalMultipartParserPool pool;
+    size_t downstream_size;
+
+    Connection **paused; // Connections waiting for their downstream to drain
+    size_t paused_count;
+
+    double *latencies; // Seconds from read() to that chunk being fully parsed
+    size_t latency_count;
+    size_t latency_capacity;
+
+    unsigned long long pauses;
+    size_t payload_size;
+    unsigned int parts;
+    unsigned int closed;
+    bool failed;
+};
+
+typedef struct Client
+{
+    const Upload *upload;
+    unsigned short port;
+    unsigned int connections;
+    bool failed;
+} Client;
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// A small field and a file of `file_size` random bytes
+static bool generate_upload(Upload *upload, const size_t file_size)
+{
+    const char head[] = INGEST_CONTENT_TYPE "\r\n"
+                        "--" INGEST_BOUNDARY "\r\n"
+                        "Content-Disposition: form-data; name=\"description\"\r\n"
+                        "\r\n"
+                        "nightly sensor dump\r\n"
+                        "--" INGEST_BOUNDARY "\r\n"
+                        "Content-Disposition: form-data; name=\"file\"; filename=\"dump.bin\"\r\n"
+                        "Content-Type: application/octet-stream\r\n"
+                        "\r\n";
+    const char tail[] = "\r\n--" INGEST_BOUNDARY "--\r\n";
+
+    upload->size = sizeof(head) - 1 + file_size + sizeof(tail) - 1;
+    upload->data = malloc(upload->size);
+    if (!upload->data)
+    {
+        return false;
+    }
+    memcpy(upload->data, head, sizeof(head) - 1);
+    char *file = &upload->data[sizeof(head) - 1];
+    for (size_t i = 0; i < file_size; i++)
+    {
+        // Random bytes are vanishingly unlikely to spell out the 38 byte delimiter
+        file[i] = (char)prng();
+    }
+    memcpy(&file[file_size], tail, sizeof(tail) - 1);
+    upload->payload_size = strlen("nightly sensor dump") + file_size;
+    upload->parts = 2;
+    return true;
+}
+
+// Client side: every connection is opened up front, then each writes its upload as fast as the server lets it
+static void *client_thread(void *argument)
+{
+    Client *client = argument;
+    int epoll_fd = epoll_create1(0);
+    size_t *offsets = calloc(client->connections, sizeof(size_t));
+    if (epoll_fd < 0 || !offsets)
+    {
+        client->failed = true;
+        return NULL;
+    }
+
+    struct sockaddr_in address = {0};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(client->port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    for (unsigned int i = 0; i < client->connections; i++)
+    {
+        const int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (fd < 0 || (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0 && errno != EINPROGRESS))
+        {
+            perror("connect");
+            client->failed = true;
+            return NULL;
+        }
+        struct epoll_event event = {EPOLLOUT, {.u64 = ((unsigned long long)i << 32) | (unsigned int)fd}};
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    }
+
+    unsigned int done = 0;
+    struct epoll_event events[EPOLL_BATCH];
+    while (done < client->connections)
+    {
+        const int count = epoll_wait(epoll_fd, events, EPOLL_BATCH, -1);
+        for (int e = 0; e < count; e++)
+        {
+            const unsigned int i = (unsigned int)(events[e].data.u64 >> 32);
+            const int fd = (int)(events[e].data.u64 & 0xFFFFFFFFu);
+            const size_t remaining = client->upload->size - offsets[i];
+            ssize_t written = write(fd, &client->upload->data[offsets[i]], remaining < WRITE_CHUNK_SIZE ? remaining : WRITE_CHUNK_SIZE);
+            if (written < 0 && errno != EAGAIN && errno != EINTR)
+            {
+                perror("write");
+                client->failed = true;
+                written = 0;
+            }
+            offsets[i] += written > 0 ? (size_t)written : 0;
+            if (offsets[i] == client->upload->size || client->failed)
+            {
+                // Whole upload sent, closing is the end of request marker
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+                close(fd);
+                done++;
+            }
+        }
+    }
+
+    free(offsets);
+    close(epoll_fd);
+    return NULL;
+}
+
+static void on_data(void *user_data, const char *data, const size_t size)
+{
+    Connection *connection = user_data;
+    connection->payload_size += size;
+    connection->queued += size;
+    if (connection->queued >= connection->server->downstream_size)
+    {
+        // Downstream is full, stop here until it drains
+        connection->sink.paused = true;
+    }
+}
+
+static void on_part_end(void *user_data, const MinimalMultipartParserContext *context)
+{
+    Connection *connection = user_data;
+    connection->parts++;
+}
+
+static void latency_add(Server *server, const double seconds)
+{
+    if (server->latency_count == server->latency_capacity)
+    {
+        server->latency_capacity = server->latency_capacity ? server->latency_capacity * 2 : 4096;
+        double *latencies = realloc(server->latencies, server->latency_capacity * sizeof(double));
+        if (!latencies)
+        {
+            server->failed = true;
+            return;
+        }
+        server->latencies = latencies;
+    }
+    server->latencies[server->latency_count++] = seconds;
+}
+
+static void interest(Server *server, Connection *connection, const unsigned int events)
+{
+    struct epoll_event event = {events, {.ptr = connection}};
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+}
+
+// Parse what is left of the last read. False if the sink paused, in which case the connection stops being read until it resumes
+static bool parse_pending(Server *server, Connection *connection)
+{
+    const size_t used = minimal_multipart_parser_process_sink(connection->context, &connection->sink, &connection->buffer[connection->pending_offset], connection->pending);
+    connection->pending_offset += used;
+    connection->pending -= used;
+    if (connection->sink.paused)
+    {
+        server->pauses++;
+        if (!connection->paused)
+        {
+            connection->paused = true;
+            server->paused[server->paused_count++] = connection;
+            interest(server, connection, 0);
+        }
+        return false;
+    }
+    if (connection->pending > 0)
+    {
+        // Limit exceeded, the rest of this upload is not worth reading
+        server->failed = true;
+    }
+    latency_add(server, now_seconds() - connection->read_time);
+    return true;
+}
+
+static void connection_close(Server *server, Connection *connection)
+{
+    if (connection->context)
+    {
+        // Upload was cut short if the body did not close
+        if (!minimal_multipart_parser_is_multipart_completed(connection->context))
+        {
+            minimal_multipart_parser_sink_flush(&connection->sink);
+        }
+        minimal_multipart_parser_pool_release(&server->pool, connection->context);
+    }
+    server->payload_size += connection->payload_size;
+    server->parts += connection->parts;
+    server->closed++;
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+    close(connection->fd);
+    free(connection);
+}
+
+static void connection_read(Server *server, Connection *connection)
+{
+    const size_t head = connection->context ? 0 : connection->pending;
+    const ssize_t got = read(connection->fd, &connection->buffer[head], sizeof(connection->buffer) - head);
+    if (got < 0 && (errno == EAGAIN || errno == EINTR))
+    {
+        return;
+    }
+    if (got <= 0)
+    {
+        connection_close(server, connection);
+        return;
+    }
+    connection->read_time = now_seconds();
+    connection->pending_offset = 0;
+    connection->pending = head + (size_t)got;
+
+    if (!connection->context)
+    {
+        // Request head first, which names the boundary this upload uses
+        const char *end = memchr(connection->buffer, '\n', connection->pending);
+        if (!end)
+        {
+            return;
+        }
+        const size_t line_size = (size_t)(end - connection->buffer) + 1;
+        connection->context = minimal_multipart_parser_pool_acquire(&server->pool, connection->buffer, line_size - 2, NULL);
+        if (!connection->context)
+        {
+            fprintf(stderr, "no context for this upload\n");
+            server->failed = true;
+            connection_close(server, connection);
+            return;
+        }
+        connection->pending_offset = line_size;
+        connection->pending -= line_size;
+    }
+
+    parse_pending(server, connection);
+}
+
+// Downstream gets through half its queue per turn of the loop. Connections that can take more again carry on parsing
+static void drain(Server *server)
+{
+    size_t kept = 0;
+    for (size_t i = 0; i < server->paused_count; i++)
+    {
+        Connection *connection = server->paused[i];
+        const size_t drained = server->downstream_size / 2;
+        connection->queued = connection->queued > drained ? connection->queued - drained : 0;
+        if (connection->queued >= server->downstream_size || !parse_pending(server, connection))
+        {
+            server->paused[kept++] = connection;
+            continue;
+        }
+        connection->paused = false;
+        interest(server, connection, EPOLLIN);
+    }
+    server->paused_count = kept;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    const double x = *(const double *)a;
+    const double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int connections = 1000;
+    size_t body_kb = 1024;
+    size_t downstream_kb = 64;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--connections") == 0 && i + 1 < argc)
+        {
+            connections = (unsigned int)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--body-kb") == 0 && i + 1 < argc)
+        {
+            body_kb = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--downstream-kb") == 0 && i + 1 < argc)
+        {
+            downstream_kb = strtoul(argv[++i], NULL, 10);
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [--connections N] [--body-kb N] [--downstream-kb N]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (connections == 0 || downstream_kb == 0)
+    {
+        fprintf(stderr, "need at least one connection and some downstream\n");
+        return 2;
+    }
+
+    // Both ends of every connection live in this process
+    struct rlimit files;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < 2 * (rlim_t)connections + 16)
+    {
+        files.rlim_cur = files.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &files);
+        if (files.rlim_cur < 2 * (rlim_t)connections + 16)
+        {
+            fprintf(stderr, "open file limit too low for %u connections\n", connections);
+            return 2;
+        }
+    }
+
+    Upload upload = {0};
+    Server server = {0};
+    server.downstream_size = downstream_kb * 1024;
+    MinimalMultipartParserPoolSlot *slots = calloc(connections, sizeof(MinimalMultipartParserPoolSlot));
+    MinimalMultipartParserPoolBoundary *boundaries = calloc(connections, sizeof(MinimalMultipartParserPoolBoundary));
+    server.paused = calloc(connections, sizeof(Connection *));
+    if (!generate_upload(&upload, body_kb * 1024) || !slots || !boundaries || !server.paused)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 2;
+    }
+    minimal_multipart_parser_pool_init(&server.pool, slots, connections, boundaries, connections);
+
+    server.listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    struct sockaddr_in address = {0};
+    socklen_t address_size = sizeof(address);
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (server.listen_fd < 0 || bind(server.listen_fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(server.listen_fd, SOMAXCONN) != 0 ||
+        getsockname(server.listen_fd, (struct sockaddr *)&address, &address_size) != 0)
+    {
+        perror("listen");
+        return 2;
+    }
+    server.epoll_fd = epoll_create1(0);
+    struct epoll_event listen_event = {EPOLLIN, {.ptr = NULL}};
+    epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.listen_fd, &listen_event);
+
+    Client client = {&upload, ntohs(address.sin_port), connections, false};
+    pthread_t client_id;
+    const double start = now_seconds();
+    pthread_create(&client_id, NULL, client_thread, &client);
+
+    struct epoll_event events[EPOLL_BATCH];
+    while (server.closed < connections && !server.failed)
+    {
+        // Do not sleep while some connection is only waiting for its downstream
+        const int count = epoll_wait(server.epoll_fd, events, EPOLL_BATCH, server.paused_count > 0 ? 0 : 1000);
+        for (int e = 0; e < count; e++)
+        {
+            Connection *connection = events[e].data.ptr;
+            if (connection && connection->paused)
+            {
+                // Only errors are reported while it is not being read, the read that finds them is left until it resumes
+                continue;
+            }
+            if (connection)
+            {
+                connection_read(&server, connection);
+                continue;
+            }
+
+            // New connections
+            for (;;)
+            {
+                const int fd = accept4(server.listen_fd, NULL, NULL, SOCK_NONBLOCK);
+                if (fd < 0)
+                {
+                    break;
+                }
+                connection = calloc(1, sizeof(Connection));
+                if (!connection)
+                {
+                    server.failed = true;
+                    close(fd);
+                    break;
+                }
+                connection->server = &server;
+                connection->fd = fd;
+                connection->sink = (MinimalMultipartParserSink){NULL, on_data, on_part_end, connection, NULL, 0, 0};
+                struct epoll_event event = {EPOLLIN, {.ptr = connection}};
+                epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, fd, &event);
+            }
+        }
+        drain(&server);
+    }
+    const double seconds = now_seconds() - start;
+    pthread_join(client_id, NULL);
+
+    const size_t expected_payload = (size_t)connections * upload.payload_size;
+    const unsigned int expected_parts = connections * upload.parts;
+    if (server.failed || client.failed || server.payload_size != expected_payload || server.parts != expected_parts)
+    {
+        fprintf(stderr, "ingest: got %zu payload bytes in %u parts, expected %zu in %u\n", server.payload_size, server.parts, expected_payload, expected_parts);
+        return 1;
+    }
+
+    qsort(server.latencies, server.latency_count, sizeof(double), compare_double);
+    const double p50 = server.latency_count ? server.latencies[server.latency_count / 2] : 0;
+    const double p99 = server.latency_count ? server.latencies[server.latency_count * 99 / 100] : 0;
+    printf("{\"commit\":\"%s\",\"build\":\"compact\",\"case\":\"ingest\",\"api\":\"sink\",\"connections\":%u,\"bytes\":%zu,\"seconds\":%.6f,\"mb_per_s\":%.2f,"
+           "\"chunks\":%zu,\"pauses\":%llu,\"chunk_p50_us\":%.1f,\"chunk_p99_us\":%.1f}\n",
+           BENCH_COMMIT, connections, (size_t)connections * upload.size, seconds, (double)connections * (double)upload.size / seconds / (1024.0 * 1024.0),
+           server.latency_count, server.pauses, p50 * 1e6, p99 * 1e6);
+
+    free(server.latencies);
+    free(server.paused);
+    free(slots);
+    free(boundaries);
+    free(upload.data);
+    return 0;
+}
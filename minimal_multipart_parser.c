@@ -9,8 +9,59 @@
 
 #include "minimal_multipart_parser.h"
 #include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
 
-static inline unsigned int buffer_count(MinimalMultipartParserCharBuffer *context) { return context->count; }
+// A compact context points at its boundary descriptor and part info, the default one holds its own, and with a fixed boundary
+// the delimiter is a string literal so its bytes and length are constants the compiler can fold into each comparison
+#ifdef MINIMAL_MULTIPART_PARSER_COMPACT_CONTEXT
+static inline const char *context_delimiter(const MinimalMultipartParserContext *context) { return context->boundary->string.buffer; }
+static inline unsigned int context_delimiter_count(const MinimalMultipartParserContext *context) { return context->boundary->string.count; }
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_SKIP_TABLE
+static inline unsigned int context_delimiter_skip(const MinimalMultipartParserContext *context, const unsigned char c) { return context->boundary->skip[c]; }
+#endif
+static inline bool context_boundary_known(const MinimalMultipartParserContext *context) { return context->boundary && context->boundary->known; }
+static inline MinimalMultipartParserPartInfo *context_part(MinimalMultipartParserContext *context) { return context->part; }
+#elif defined(MINIMAL_MULTIPART_PARSER_FIXED_BOUNDARY)
+static const char fixed_delimiter[] = MINIMAL_MULTIPART_PARSER_BOUNDARY_START_MARKER MINIMAL_MULTIPART_PARSER_FIXED_BOUNDARY;
+static inline const char *context_delimiter(const MinimalMultipartParserContext *context) { return fixed_delimiter; }
+static inline unsigned int context_delimiter_count(const MinimalMultipartParserContext *context) { return sizeof(fixed_delimiter) - 1; }
+static inline bool context_boundary_known(const MinimalMultipartParserContext *context) { return true; }
+static inline MinimalMultipartParserPartInfo *context_part(MinimalMultipartParserContext *context) { return &(context->part); }
+#else
+static inline const char *context_delimiter(const MinimalMultipartParserContext *context) { return context->boundary.string.buffer; }
+static inline unsigned int context_delimiter_count(const MinimalMultipartParserContext *context) { return context->boundary.string.count; }
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_SKIP_TABLE
+static inline unsigned int context_delimiter_skip(const MinimalMultipartParserContext *context, const unsigned char c) { return context->boundary.skip[c]; }
+#endif
+static inline bool context_boundary_known(const MinimalMultipartParserContext *context) { return context->boundary.known; }
+static inline MinimalMultipartParserPartInfo *context_part(MinimalMultipartParserContext *context) { return &(context->part); }
+#endif
+
+// Only a context holding its own boundary buffer can take the boundary from the first `--BOUNDARY` line of the body
+#if !defined(MINIMAL_MULTIPART_PARSER_COMPACT_CONTEXT) && !defined(MINIMAL_MULTIPART_PARSER_FIXED_BOUNDARY)
+#define MINIMAL_MULTIPART_PARSER_BOUNDARY_DISCOVERY
+#endif
+
+// Instrumentation counters, compiled out unless asked for
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_STATS
+#define STATS_ADD(context, counter, amount) ((context)->stats.counter += (amount))
+#else
+#define STATS_ADD(context, counter, amount) ((void)0)
+#endif
+
+static inline MultipartParserEvent stats_event(MinimalMultipartParserContext *context, const MultipartParserEvent event)
+{
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_STATS
+    if (event != MultipartParserEvent_None)
+    {
+        context->stats.events[event]++;
+    }
+#endif
+    return event;
+}
+
+static inline unsigned int buffer_count(const MinimalMultipartParserCharBuffer *context) { return context->count; }
 
 static inline void buffer_reset(MinimalMultipartParserCharBuffer *context)
 {
@@ -31,181 +82,2443 @@ static inline bool buffer_add(MinimalMultipartParserCharBuffer *context, const c
     return true;
 }
 
-MultipartParserEvent minimal_multipart_parser_process(MinimalMultipartParserContext *context, const char c)
+// What one delimiter search did, for the stats counters
+typedef struct ScanCounts
 {
-    MinimalMultipartParserCharBuffer *boundaryBuffer = &(context->boundary);
-    MinimalMultipartParserCharBuffer *dataBuffer = &(context->data);
+    size_t rejected;  // Places that had to be compared against the whole delimiter but were not one
+    size_t inspected; // Bytes read, counting a byte again each time it is read again. Only kept with stats on
+} ScanCounts;
 
-    if (context->data_available)
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_STATS
+#define SCAN_INSPECTED(counts, amount) ((counts)->inspected += (amount))
+#else
+#define SCAN_INSPECTED(counts, amount) ((void)(counts))
+#endif
+
+// Does `buffer` start the way the full `\r\n--BOUNDARY` delimiter does? At the end of a chunk `size` may be less than the
+// delimiter length, in which case the rest of it may still come in the next chunk.
+static inline bool boundary_prefix_match(const MinimalMultipartParserContext *context, const char *buffer, const size_t size, ScanCounts *counts)
+{
+    const char *delimiter = context_delimiter(context);
+    const size_t delimiter_count = context_delimiter_count(context);
+    const size_t count = size < delimiter_count ? size : delimiter_count;
+    for (size_t i = 0; i < count; i++)
     {
-        buffer_reset(dataBuffer);
-        context->data_available = false;
+        if (buffer[i] != delimiter[i])
+        {
+            SCAN_INSPECTED(counts, i + 1);
+            return false;
+        }
+    }
+    SCAN_INSPECTED(counts, count);
+    return true;
+}
+
+// Mark the delimiter as complete, and precompute its Horspool bad character shift table if there is one
+static void boundary_compile(MinimalMultipartParserBoundary *boundary)
+{
+    boundary->known = true;
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_SKIP_TABLE
+    const unsigned int count = boundary->string.count;
+    for (unsigned int i = 0; i < 256; i++)
+    {
+        boundary->skip[i] = (unsigned char)count;
+    }
+    for (unsigned int i = 0; i + 1 < count; i++)
+    {
+        boundary->skip[(unsigned char)boundary->string.buffer[i]] = (unsigned char)(count - 1 - i);
     }
+#endif
+}
 
-    if (context->phase == MultipartParserPhase_INIT)
+#if defined(MINIMAL_MULTIPART_PARSER_ENABLE_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || (defined(__aarch64__) && defined(__ARM_NEON)))
+#define MINIMAL_MULTIPART_PARSER_SIMD_SCANNER
+
+// The vector scanners below return the offset of the first byte in `buffer` from `start` onwards that could begin a
+// `\r\n--BOUNDARY` delimiter, or `size` if there is none. A whole delimiter has to fit for a place to be a candidate, and to
+// be one it needs `\r\n` at its start and the last delimiter byte `last` at `last_offset`. Checking both ends in the same
+// vector pass throws out nearly all of the `\r\n` pairs in text, and the runs of near misses a hostile body is made of, without
+// leaving the vector loop. The last few bytes, where only part of a delimiter fits, go through scan_scalar().
+
+// Candidates are `\r\n` pairs plus a trailing `\r` whose `\n` may be in the next chunk
+static inline size_t scan_scalar(const char *buffer, const size_t size, size_t start)
+{
+    for (size_t i = start; i < size; i++)
     {
-        switch (c)
+        if (buffer[i] == '\r' && (i + 1 == size || buffer[i + 1] == '\n'))
         {
-            case '\r':
-                context->phase = MultipartParserPhase_Preamble_CR;
-                return MultipartParserEvent_None;
-            case '-':
-                context->phase = MultipartParserPhase_Preamble_HYPHEN;
-                return MultipartParserEvent_None;
-            default:
-                context->phase = MultipartParserPhase_Preamble_SKIP_LINE;
-                return MultipartParserEvent_None;
+            return i;
         }
     }
+    return size;
+}
+#endif
 
-    if (context->phase == MultipartParserPhase_Preamble_SKIP_LINE)
+#if defined(MINIMAL_MULTIPART_PARSER_SIMD_SCANNER) && defined(__x86_64__)
+#include <immintrin.h>
+
+#ifndef __AVX2__
+// SSE2 is part of the x86-64 baseline. Compares 16 byte windows at `i`, `i + 1` and `i + last_offset` so a hit has both ends
+static size_t scan_sse2(const char *buffer, const size_t size, size_t i, const size_t last_offset, const char last)
+{
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i end = _mm_set1_epi8(last);
+    for (; i + last_offset + 16 <= size; i += 16)
     {
-        switch (c)
+        const __m128i first = _mm_loadu_si128((const __m128i *)(buffer + i));
+        const __m128i second = _mm_loadu_si128((const __m128i *)(buffer + i + 1));
+        const __m128i tail = _mm_loadu_si128((const __m128i *)(buffer + i + last_offset));
+        const __m128i hits = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(first, cr), _mm_cmpeq_epi8(second, lf)), _mm_cmpeq_epi8(tail, end));
+        const int mask = _mm_movemask_epi8(hits);
+        if (mask != 0)
         {
-            case '\r':
-                context->phase = MultipartParserPhase_Preamble_CR;
-                return MultipartParserEvent_None;
-            case '\n':
-                context->phase = MultipartParserPhase_Preamble_LF;
-                return MultipartParserEvent_None;
-            default:
-                return MultipartParserEvent_None;
+            return i + __builtin_ctz(mask);
         }
     }
+    return scan_scalar(buffer, size, i);
+}
+#endif
 
-    if (context->phase == MultipartParserPhase_Preamble_CR)
+__attribute__((target("avx2"))) static size_t scan_avx2(const char *buffer, const size_t size, size_t i, const size_t last_offset, const char last)
+{
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const __m256i end = _mm256_set1_epi8(last);
+    for (; i + last_offset + 32 <= size; i += 32)
     {
-        switch (c)
+        const __m256i first = _mm256_loadu_si256((const __m256i *)(buffer + i));
+        const __m256i second = _mm256_loadu_si256((const __m256i *)(buffer + i + 1));
+        const __m256i tail = _mm256_loadu_si256((const __m256i *)(buffer + i + last_offset));
+        const __m256i hits = _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(first, cr), _mm256_cmpeq_epi8(second, lf)), _mm256_cmpeq_epi8(tail, end));
+        const unsigned int mask = (unsigned int)_mm256_movemask_epi8(hits);
+        if (mask != 0)
         {
-            case '\n':
-                context->phase = MultipartParserPhase_Preamble_LF;
-                return MultipartParserEvent_None;
-            default:
-                context->phase = MultipartParserPhase_Preamble_SKIP_LINE;
-                return MultipartParserEvent_None;
+            return i + __builtin_ctz(mask);
         }
     }
+    return scan_scalar(buffer, size, i);
+}
 
-    if (context->phase == MultipartParserPhase_Preamble_LF)
+static size_t scan_candidate(const MinimalMultipartParserContext *context, const char *buffer, const size_t size, size_t start)
+{
+    const size_t last_offset = context_delimiter_count(context) - 1;
+    const char last = context_delimiter(context)[last_offset];
+#ifdef __AVX2__
+    return scan_avx2(buffer, size, start, last_offset, last);
+#else
+    // Pick the widest scanner the cpu supports on first use
+    static int has_avx2 = -1;
+    if (has_avx2 < 0)
     {
-        switch (c)
+        __builtin_cpu_init();
+        has_avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+    }
+    return has_avx2 ? scan_avx2(buffer, size, start, last_offset, last) : scan_sse2(buffer, size, start, last_offset, last);
+#endif
+}
+
+#elif defined(MINIMAL_MULTIPART_PARSER_SIMD_SCANNER)
+#include <arm_neon.h>
+
+static size_t scan_candidate(const MinimalMultipartParserContext *context, const char *buffer, const size_t size, size_t i)
+{
+    const size_t last_offset = context_delimiter_count(context) - 1;
+    const uint8x16_t cr = vdupq_n_u8('\r');
+    const uint8x16_t lf = vdupq_n_u8('\n');
+    const uint8x16_t end = vdupq_n_u8((uint8_t)context_delimiter(context)[last_offset]);
+    for (; i + last_offset + 16 <= size; i += 16)
+    {
+        const uint8x16_t first = vld1q_u8((const uint8_t *)(buffer + i));
+        const uint8x16_t second = vld1q_u8((const uint8_t *)(buffer + i + 1));
+        const uint8x16_t tail = vld1q_u8((const uint8_t *)(buffer + i + last_offset));
+        const uint8x16_t hits = vandq_u8(vandq_u8(vceqq_u8(first, cr), vceqq_u8(second, lf)), vceqq_u8(tail, end));
+        // Narrow each byte lane to a nibble so the whole compare result fits in 64 bits
+        const uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hits), 4)), 0);
+        if (mask != 0)
         {
-            case '-':
-                context->phase = MultipartParserPhase_Preamble_HYPHEN;
-                return MultipartParserEvent_None;
-            default:
-                context->phase = MultipartParserPhase_Preamble_SKIP_LINE;
-                return MultipartParserEvent_None;
+            return i + (__builtin_ctzll(mask) >> 2);
         }
     }
+    return scan_scalar(buffer, size, i);
+}
 
-    if (context->phase == MultipartParserPhase_Preamble_HYPHEN)
+#endif
+
+// Returns the offset of the first place in `buffer` where the `\r\n--BOUNDARY` delimiter starts, or `size` if there is none.
+// Near the end of `buffer` a partial delimiter also counts, as the rest of it may be in the next chunk.
+// What the search did is added to `counts`.
+static size_t scan_for_boundary(const MinimalMultipartParserContext *context, const char *buffer, const size_t size, ScanCounts *counts)
+{
+#ifdef MINIMAL_MULTIPART_PARSER_SIMD_SCANNER
+    // Vector search for places with both ends of the delimiter, then only compare the full delimiter at those
+    for (size_t i = 0;; i++)
     {
-        // Previously got a dash in '\r\n--', seeking another dash
-        switch (c)
+        const size_t candidate = scan_candidate(context, buffer, size, i);
+        SCAN_INSPECTED(counts, (candidate < size ? candidate : size) - i);
+        i = candidate;
+        if (i >= size || boundary_prefix_match(context, &buffer[i], size - i, counts))
         {
-            case '-':
-                context->phase = MultipartParserPhase_GetBoundary;
-                buffer_add(boundaryBuffer, '\r');
-                buffer_add(boundaryBuffer, '\n');
-                buffer_add(boundaryBuffer, '-');
-                buffer_add(boundaryBuffer, '-');
-                return MultipartParserEvent_None;
-            default:
-                context->phase = MultipartParserPhase_Preamble_SKIP_LINE;
-                return MultipartParserEvent_None;
+            return i;
         }
+        counts->rejected++;
+    }
+#elif defined(MINIMAL_MULTIPART_PARSER_ENABLE_SKIP_TABLE) && !defined(MINIMAL_MULTIPART_PARSER_FIXED_BOUNDARY)
+    // Horspool search, which on average skips ahead by close to the delimiter length per step
+    const size_t count = context_delimiter_count(context);
+    const char *pattern = context_delimiter(context);
+    size_t i = 0;
+    while (i + count <= size)
+    {
+        const unsigned char last = (unsigned char)buffer[i + count - 1];
+        SCAN_INSPECTED(counts, 1);
+        if (last == (unsigned char)pattern[count - 1])
+        {
+            if (boundary_prefix_match(context, &buffer[i], count, counts))
+            {
+                return i;
+            }
+            counts->rejected++;
+        }
+        i += context_delimiter_skip(context, last);
     }
 
-    if (context->phase == MultipartParserPhase_GetBoundary)
+    // Skipped positions cannot start even a partial delimiter, so only the leftover tail needs a closer look
+    for (; i < size; i++)
     {
-        switch (c)
+        if (boundary_prefix_match(context, &buffer[i], size - i, counts))
         {
-            case '\r':
-                context->phase = MultipartParserPhase_GetBoundary_Done;
-                return MultipartParserEvent_None;
-            default:
-                if ((c < ' ') || ('~' < c))
-                {
-                    context->phase = MultipartParserPhase_Preamble_SKIP_LINE;
-                    buffer_reset(dataBuffer);
-                    return MultipartParserEvent_None;
-                }
-                if (!buffer_add(boundaryBuffer, c))
-                {
-                    context->phase = MultipartParserPhase_Preamble_SKIP_LINE;
-                    buffer_reset(dataBuffer);
-                    return MultipartParserEvent_None;
-                }
-                return MultipartParserEvent_None;
+            return i;
+        }
+    }
+    return size;
+#else
+    // Every delimiter starts with `\r`, so jump from one to the next and only compare the rest where the last byte matches too
+    const size_t last_offset = context_delimiter_count(context) - 1;
+    const char last = context_delimiter(context)[last_offset];
+    for (size_t i = 0; i < size; i++)
+    {
+        const char *found = memchr(&buffer[i], '\r', size - i);
+        const size_t candidate = found ? (size_t)(found - buffer) : size;
+        SCAN_INSPECTED(counts, (candidate < size ? candidate + 1 : size) - i);
+        i = candidate;
+        if (i >= size)
+        {
+            return size;
         }
+        if (i + last_offset < size && buffer[i + last_offset] != last)
+        {
+            SCAN_INSPECTED(counts, 1);
+            continue;
+        }
+        if (boundary_prefix_match(context, &buffer[i], size - i, counts))
+        {
+            return i;
+        }
+        counts->rejected++;
+    }
+    return size;
+#endif
+}
+
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_DIGEST
+
+// CRC32C (Castagnoli, reflected polynomial 0x82F63B78), one byte at a time
+static const uint32_t crc32c_table[256] = {
+    0x00000000, 0xF26B8303, 0xE13B70F7, 0x1350F3F4, 0xC79A971F, 0x35F1141C, 0x26A1E7E8, 0xD4CA64EB,
+    0x8AD958CF, 0x78B2DBCC, 0x6BE22838, 0x9989AB3B, 0x4D43CFD0, 0xBF284CD3, 0xAC78BF27, 0x5E133C24,
+    0x105EC76F, 0xE235446C, 0xF165B798, 0x030E349B, 0xD7C45070, 0x25AFD373, 0x36FF2087, 0xC494A384,
+    0x9A879FA0, 0x68EC1CA3, 0x7BBCEF57, 0x89D76C54, 0x5D1D08BF, 0xAF768BBC, 0xBC267848, 0x4E4DFB4B,
+    0x20BD8EDE, 0xD2D60DDD, 0xC186FE29, 0x33ED7D2A, 0xE72719C1, 0x154C9AC2, 0x061C6936, 0xF477EA35,
+    0xAA64D611, 0x580F5512, 0x4B5FA6E6, 0xB93425E5, 0x6DFE410E, 0x9F95C20D, 0x8CC531F9, 0x7EAEB2FA,
+    0x30E349B1, 0xC288CAB2, 0xD1D83946, 0x23B3BA45, 0xF779DEAE, 0x05125DAD, 0x1642AE59, 0xE4292D5A,
+    0xBA3A117E, 0x4851927D, 0x5B016189, 0xA96AE28A, 0x7DA08661, 0x8FCB0562, 0x9C9BF696, 0x6EF07595,
+    0x417B1DBC, 0xB3109EBF, 0xA0406D4B, 0x522BEE48, 0x86E18AA3, 0x748A09A0, 0x67DAFA54, 0x95B17957,
+    0xCBA24573, 0x39C9C670, 0x2A993584, 0xD8F2B687, 0x0C38D26C, 0xFE53516F, 0xED03A29B, 0x1F682198,
+    0x5125DAD3, 0xA34E59D0, 0xB01EAA24, 0x42752927, 0x96BF4DCC, 0x64D4CECF, 0x77843D3B, 0x85EFBE38,
+    0xDBFC821C, 0x2997011F, 0x3AC7F2EB, 0xC8AC71E8, 0x1C661503, 0xEE0D9600, 0xFD5D65F4, 0x0F36E6F7,
+    0x61C69362, 0x93AD1061, 0x80FDE395, 0x72966096, 0xA65C047D, 0x5437877E, 0x4767748A, 0xB50CF789,
+    0xEB1FCBAD, 0x197448AE, 0x0A24BB5A, 0xF84F3859, 0x2C855CB2, 0xDEEEDFB1, 0xCDBE2C45, 0x3FD5AF46,
+    0x7198540D, 0x83F3D70E, 0x90A324FA, 0x62C8A7F9, 0xB602C312, 0x44694011, 0x5739B3E5, 0xA55230E6,
+    0xFB410CC2, 0x092A8FC1, 0x1A7A7C35, 0xE811FF36, 0x3CDB9BDD, 0xCEB018DE, 0xDDE0EB2A, 0x2F8B6829,
+    0x82F63B78, 0x709DB87B, 0x63CD4B8F, 0x91A6C88C, 0x456CAC67, 0xB7072F64, 0xA457DC90, 0x563C5F93,
+    0x082F63B7, 0xFA44E0B4, 0xE9141340, 0x1B7F9043, 0xCFB5F4A8, 0x3DDE77AB, 0x2E8E845F, 0xDCE5075C,
+    0x92A8FC17, 0x60C37F14, 0x73938CE0, 0x81F80FE3, 0x55326B08, 0xA759E80B, 0xB4091BFF, 0x466298FC,
+    0x1871A4D8, 0xEA1A27DB, 0xF94AD42F, 0x0B21572C, 0xDFEB33C7, 0x2D80B0C4, 0x3ED04330, 0xCCBBC033,
+    0xA24BB5A6, 0x502036A5, 0x4370C551, 0xB11B4652, 0x65D122B9, 0x97BAA1BA, 0x84EA524E, 0x7681D14D,
+    0x2892ED69, 0xDAF96E6A, 0xC9A99D9E, 0x3BC21E9D, 0xEF087A76, 0x1D63F975, 0x0E330A81, 0xFC588982,
+    0xB21572C9, 0x407EF1CA, 0x532E023E, 0xA145813D, 0x758FE5D6, 0x87E466D5, 0x94B49521, 0x66DF1622,
+    0x38CC2A06, 0xCAA7A905, 0xD9F75AF1, 0x2B9CD9F2, 0xFF56BD19, 0x0D3D3E1A, 0x1E6DCDEE, 0xEC064EED,
+    0xC38D26C4, 0x31E6A5C7, 0x22B65633, 0xD0DDD530, 0x0417B1DB, 0xF67C32D8, 0xE52CC12C, 0x1747422F,
+    0x49547E0B, 0xBB3FFD08, 0xA86F0EFC, 0x5A048DFF, 0x8ECEE914, 0x7CA56A17, 0x6FF599E3, 0x9D9E1AE0,
+    0xD3D3E1AB, 0x21B862A8, 0x32E8915C, 0xC083125F, 0x144976B4, 0xE622F5B7, 0xF5720643, 0x07198540,
+    0x590AB964, 0xAB613A67, 0xB831C993, 0x4A5A4A90, 0x9E902E7B, 0x6CFBAD78, 0x7FAB5E8C, 0x8DC0DD8F,
+    0xE330A81A, 0x115B2B19, 0x020BD8ED, 0xF0605BEE, 0x24AA3F05, 0xD6C1BC06, 0xC5914FF2, 0x37FACCF1,
+    0x69E9F0D5, 0x9B8273D6, 0x88D28022, 0x7AB90321, 0xAE7367CA, 0x5C18E4C9, 0x4F48173D, 0xBD23943E,
+    0xF36E6F75, 0x0105EC76, 0x12551F82, 0xE03E9C81, 0x34F4F86A, 0xC69F7B69, 0xD5CF889D, 0x27A40B9E,
+    0x79B737BA, 0x8BDCB4B9, 0x988C474D, 0x6AE7C44E, 0xBE2DA0A5, 0x4C4623A6, 0x5F16D052, 0xAD7D5351,
+};
+
+static uint32_t crc32c_scalar(uint32_t crc, const unsigned char *data, size_t size)
+{
+    for (; size > 0; size--)
+    {
+        crc = crc32c_table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
     }
+    return crc;
+}
 
-    if (context->phase == MultipartParserPhase_GetBoundary_Done)
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <nmmintrin.h>
+
+// SSE4.2 has a CRC32C instruction, doing 8 bytes at a time
+__attribute__((target("sse4.2"))) static uint32_t crc32c_sse42(uint32_t crc, const unsigned char *data, size_t size)
+{
+    uint64_t crc64 = crc;
+    for (; size >= 8; size -= 8, data += 8)
     {
-        switch (c)
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = (uint32_t)crc64;
+    for (; size > 0; size--)
+    {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+    return crc;
+}
+
+static uint32_t crc32c_update(uint32_t crc, const unsigned char *data, size_t size)
+{
+    static int has_sse42 = -1;
+    if (has_sse42 < 0)
+    {
+        __builtin_cpu_init();
+        has_sse42 = __builtin_cpu_supports("sse4.2") ? 1 : 0;
+    }
+    return has_sse42 ? crc32c_sse42(crc, data, size) : crc32c_scalar(crc, data, size);
+}
+#elif defined(__GNUC__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+
+static uint32_t crc32c_update(uint32_t crc, const unsigned char *data, size_t size)
+{
+    for (; size >= 8; size -= 8, data += 8)
+    {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        crc = __crc32cd(crc, word);
+    }
+    for (; size > 0; size--)
+    {
+        crc = __crc32cb(crc, *data++);
+    }
+    return crc;
+}
+#else
+static uint32_t crc32c_update(uint32_t crc, const unsigned char *data, size_t size) { return crc32c_scalar(crc, data, size); }
+#endif
+
+static const uint32_t sha256_k[64] = {
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5, 0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+    0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA, 0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+    0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85, 0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3, 0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2};
+
+static inline uint32_t rotate_right(const uint32_t x, const unsigned int n) { return (x >> n) | (x << (32 - n)); }
+
+static void sha256_compress(uint32_t *state, const unsigned char *block)
+{
+    uint32_t w[64];
+    for (unsigned int i = 0; i < 16; i++)
+    {
+        w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) | ((uint32_t)block[i * 4 + 2] << 8) | (uint32_t)block[i * 4 + 3];
+    }
+    for (unsigned int i = 16; i < 64; i++)
+    {
+        const uint32_t s0 = rotate_right(w[i - 15], 7) ^ rotate_right(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        const uint32_t s1 = rotate_right(w[i - 2], 17) ^ rotate_right(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6], h = state[7];
+    for (unsigned int i = 0; i < 64; i++)
+    {
+        const uint32_t t1 = h + (rotate_right(e, 6) ^ rotate_right(e, 11) ^ rotate_right(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        const uint32_t t2 = (rotate_right(a, 2) ^ rotate_right(a, 13) ^ rotate_right(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+static void digest_begin(MinimalMultipartParserDigest *digest)
+{
+    static const uint32_t sha256_initial[8] = {0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19};
+    digest->crc32c = 0xFFFFFFFF;
+    memcpy(digest->sha256_state, sha256_initial, sizeof(sha256_initial));
+    digest->sha256_size = 0;
+}
+
+static void digest_update(MinimalMultipartParserDigest *digest, const unsigned char *data, size_t size)
+{
+    digest->crc32c = crc32c_update(digest->crc32c, data, size);
+
+    // Top up a partly filled block first, then hash whole blocks straight from the input
+    size_t held = (size_t)(digest->sha256_size % 64);
+    digest->sha256_size += size;
+    if (held > 0)
+    {
+        const size_t take = (64 - held) < size ? (64 - held) : size;
+        memcpy(&digest->sha256_block[held], data, take);
+        data += take;
+        size -= take;
+        held += take;
+        if (held < 64)
         {
-            case '\n':
-                context->phase = MultipartParserPhase_SkipFileHeader;
-                return MultipartParserEvent_FileStreamFound;
-            default:
-                context->phase = MultipartParserPhase_Preamble_SKIP_LINE;
-                buffer_reset(dataBuffer);
-                return MultipartParserEvent_None;
+            return;
         }
+        sha256_compress(digest->sha256_state, digest->sha256_block);
+    }
+    for (; size >= 64; size -= 64, data += 64)
+    {
+        sha256_compress(digest->sha256_state, data);
+    }
+    memcpy(digest->sha256_block, data, size);
+}
+
+static void digest_finish(MinimalMultipartParserDigest *digest)
+{
+    digest->crc32c ^= 0xFFFFFFFF;
+
+    // Pad with 0x80, zeros and the size in bits, then keep the hash where the block buffer was
+    const uint64_t bits = digest->sha256_size * 8;
+    size_t held = (size_t)(digest->sha256_size % 64);
+    digest->sha256_block[held++] = 0x80;
+    if (held > 56)
+    {
+        memset(&digest->sha256_block[held], 0, 64 - held);
+        sha256_compress(digest->sha256_state, digest->sha256_block);
+        held = 0;
+    }
+    memset(&digest->sha256_block[held], 0, 56 - held);
+    for (unsigned int i = 0; i < 8; i++)
+    {
+        digest->sha256_block[56 + i] = (unsigned char)(bits >> (56 - i * 8));
+    }
+    sha256_compress(digest->sha256_state, digest->sha256_block);
+
+    memset(digest->sha256_block, 0, sizeof(digest->sha256_block));
+    for (unsigned int i = 0; i < 32; i++)
+    {
+        digest->sha256_block[i] = (unsigned char)(digest->sha256_state[i / 4] >> (24 - (i % 4) * 8));
+    }
+}
+#endif
+
+static inline void data_release(MinimalMultipartParserContext *context)
+{
+    // Caller had its chance to read the last released bytes, so reclaim the data buffer
+    if (context->data_available)
+    {
+#ifndef MINIMAL_MULTIPART_PARSER_COMPACT_CONTEXT
+        buffer_reset(&(context->data));
+#endif
+        context->data_view_size = 0;
+        context->data_available = false;
+    }
+}
+
+// Stop parsing for good, the rest of the body is ignored
+static MultipartParserEvent limit_exceeded(MinimalMultipartParserContext *context)
+{
+    context->phase = MultipartParserPhase_LimitExceeded;
+    context->boundary_match = 0;
+    return MultipartParserEvent_LimitExceeded;
+}
+
+// Count bytes against the current section (preamble, part header or part body). False once over `limit`, where 0 is no limit
+static inline bool section_add(MinimalMultipartParserContext *context, const size_t size, const size_t limit)
+{
+    context->section_size += size;
+    return limit == 0 || context->section_size <= limit;
+}
+
+static inline MultipartParserEvent data_emit(MinimalMultipartParserContext *context, const char *data, const unsigned int size)
+{
+    if (context->limits && !section_add(context, size, context->limits->part_bytes))
+    {
+        return limit_exceeded(context);
+    }
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_DIGEST
+    // Every body byte passes through here once, whichever api is driving the parser
+    if (context->digest.enabled)
+    {
+        digest_update(&(context->digest), (const unsigned char *)data, size);
     }
+#endif
+    context->data_view = data;
+    context->data_view_size = size;
+    context->data_available = true;
+    return MultipartParserEvent_DataBufferAvailable;
+}
+
+// Part headers we pick values out of, in lower case as header and parameter names are case insensitive
+enum
+{
+    HEADER_CONTENT_DISPOSITION,
+    HEADER_CONTENT_TYPE,
+    HEADER_CONTENT_TRANSFER_ENCODING,
+    HEADER_COUNT
+};
+static const char *const header_names[HEADER_COUNT] = {"content-disposition", "content-type", "content-transfer-encoding"};
+
+enum
+{
+    FIELD_NONE,
+    FIELD_NAME,
+    FIELD_FILENAME,
+    FIELD_CONTENT_TYPE
+};
+static const char *const param_names[] = {"name", "filename"};
+#define PARAM_COUNT (sizeof(param_names) / sizeof(param_names[0]))
+
+// Same order as MultipartParserTransferEncoding, after identity
+static const char *const encoding_names[] = {"base64", "quoted-printable"};
+#define ENCODING_COUNT (sizeof(encoding_names) / sizeof(encoding_names[0]))
+
+static inline char ascii_lower(const char c) { return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c; }
 
-    if (context->phase == MultipartParserPhase_SkipFileHeader)
+static inline bool is_space(const char c) { return c == ' ' || c == '\t'; }
+
+// Narrow down the names that still match with one more name char. Returns the updated candidate bitmask
+static unsigned char name_match(const char *const *names, const unsigned int name_count, unsigned char candidates, const unsigned int index, const char c)
+{
+    const char lower = ascii_lower(c);
+    for (unsigned int i = 0; i < name_count; i++)
     {
-        const unsigned expected_index = buffer_count(dataBuffer);
-        const char expected_char = (MINIMAL_MULTIPART_PARSER_FILE_START_MARKER)[expected_index];
-        if (c != expected_char)
+        if ((candidates & (1u << i)) && names[i][index] != lower)
         {
-            buffer_reset(dataBuffer);
-            return MultipartParserEvent_None;
+            candidates &= (unsigned char)~(1u << i);
         }
+    }
+    return candidates;
+}
 
-        buffer_add(dataBuffer, c);
-        if (buffer_count(dataBuffer) >= MINIMAL_MULTIPART_PARSER_FILE_START_MARKER_COUNT)
+// Which of the remaining candidates was matched in full, if any
+static int name_matched(const char *const *names, const unsigned int name_count, const unsigned char candidates, const unsigned int size)
+{
+    for (unsigned int i = 0; i < name_count; i++)
+    {
+        if ((candidates & (1u << i)) && names[i][size] == '\0')
         {
-            context->phase = MultipartParserPhase_GetFileBytes;
-            buffer_reset(dataBuffer);
-            return MultipartParserEvent_FileStreamStarting;
+            return (int)i;
         }
+    }
+    return -1;
+}
 
-        return MultipartParserEvent_None;
+static void part_info_add(MinimalMultipartParserContext *context, const char c)
+{
+    MinimalMultipartParserHeaderParser *header = &(context->header);
+    MinimalMultipartParserPartInfo *part = context_part(context);
+    if (!part)
+    {
+        return;
     }
 
-    if (context->phase == MultipartParserPhase_GetFileBytes)
+    char *field = NULL;
+    unsigned int field_max = 0;
+    switch (header->field)
+    {
+        case FIELD_NAME:
+            field = part->name;
+            field_max = MINIMAL_MULTIPART_PARSER_PART_NAME_MAX_CHAR;
+            break;
+        case FIELD_FILENAME:
+            field = part->filename;
+            field_max = MINIMAL_MULTIPART_PARSER_PART_FILENAME_MAX_CHAR;
+            break;
+        case FIELD_CONTENT_TYPE:
+            field = part->content_type;
+            field_max = MINIMAL_MULTIPART_PARSER_PART_CONTENT_TYPE_MAX_CHAR;
+            break;
+        default:
+            return;
+    }
+
+    if (header->field_size >= field_max)
+    {
+        return;
+    }
+
+    field[header->field_size++] = c;
+    field[header->field_size] = '\0';
+}
+
+static inline void part_begin(MinimalMultipartParserContext *context)
+{
+    context->header.state = MultipartParserHeaderState_LineStart;
+    context->header.line_size = 0;
+    context->transfer_encoding = MultipartParserTransferEncoding_Identity;
+    context->section_size = 0;
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_STATS
+    context->stats.header_size = 0;
+#endif
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_DIGEST
+    if (context->digest.enabled)
+    {
+        digest_begin(&(context->digest));
+    }
+#endif
+
+    MinimalMultipartParserPartInfo *part = context_part(context);
+    if (part)
     {
-        const unsigned char full_boundary_size = buffer_count(boundaryBuffer);
-        const char *full_boundary_string = context->boundary.buffer;
+        part->name[0] = '\0';
+        part->filename[0] = '\0';
+        part->content_type[0] = '\0';
+    }
+}
 
-        const unsigned expected_index = buffer_count(dataBuffer);
-        const char expected_char = full_boundary_string[expected_index];
+// Got a delimiter line, so a new part starts with its headers
+static inline MultipartParserEvent part_found(MinimalMultipartParserContext *context)
+{
+    // Skipped parts count too, or a filter would let a body hold any number of unwanted ones
+    if (context->limits && context->limits->parts != 0 && context->parts_completed + context->parts_skipped >= context->limits->parts)
+    {
+        return limit_exceeded(context);
+    }
+    part_begin(context);
+    return MultipartParserEvent_FileStreamFound;
+}
 
-        buffer_add(dataBuffer, c);
+// Streaming part header parser, one header line at a time. Only the header values we care about are kept
+static MultipartParserEvent header_process(MinimalMultipartParserContext *context, const char c)
+{
+    MinimalMultipartParserHeaderParser *header = &(context->header);
 
-        if (c != expected_char)
+    if (header->state == MultipartParserHeaderState_LineStart)
+    {
+        if (c == '\r')
         {
-            context->data_available = true;
-            return MultipartParserEvent_DataBufferAvailable;
+            // Blank line, so that was the last header
+            header->state = MultipartParserHeaderState_End_CR;
+            return MultipartParserEvent_None;
         }
 
-        if (buffer_count(dataBuffer) >= full_boundary_size)
+        header->line_size = 0;
+        header->candidates = (1u << HEADER_COUNT) - 1;
+        header->name_size = 0;
+        header->state = MultipartParserHeaderState_Name;
+    }
+
+    if (header->state == MultipartParserHeaderState_End_CR)
+    {
+        if (c == '\n')
         {
-            context->phase = MultipartParserPhase_EndOfFile;
-            return MultipartParserEvent_DataStreamCompleted;
+            context->phase = MultipartParserPhase_GetFileBytes;
+            context->section_size = 0;
+            return MultipartParserEvent_FileStreamStarting;
         }
-
+        header->state = MultipartParserHeaderState_SkipLine;
         return MultipartParserEvent_None;
     }
 
-    if (context->phase == MultipartParserPhase_EndOfFile)
+    if (header->state == MultipartParserHeaderState_CR)
     {
-        // Do nothing... We already got the file now
-        return MultipartParserEvent_DataStreamCompleted;
+        header->state = (c == '\n') ? MultipartParserHeaderState_LineStart : MultipartParserHeaderState_SkipLine;
+        return MultipartParserEvent_None;
     }
 
-    return MultipartParserEvent_None;
+    if (c == '\r')
+    {
+        header->state = MultipartParserHeaderState_CR;
+        return MultipartParserEvent_None;
+    }
+
+    if (++header->line_size > MINIMAL_MULTIPART_PARSER_HEADER_LINE_MAX_CHAR)
+    {
+        // Over budget, ignore the rest of this header
+        header->line_size = MINIMAL_MULTIPART_PARSER_HEADER_LINE_MAX_CHAR;
+        header->state = MultipartParserHeaderState_SkipLine;
+    }
+
+    switch (header->state)
+    {
+        case MultipartParserHeaderState_Name:
+        {
+            if (c != ':')
+            {
+                header->candidates = name_match(header_names, HEADER_COUNT, header->candidates, header->name_size, c);
+                header->name_size = header->candidates ? header->name_size + 1 : header->name_size;
+                header->state = header->candidates ? MultipartParserHeaderState_Name : MultipartParserHeaderState_SkipLine;
+                return MultipartParserEvent_None;
+            }
+
+            switch (name_matched(header_names, HEADER_COUNT, header->candidates, header->name_size))
+            {
+                case HEADER_CONTENT_DISPOSITION:
+                    header->state = MultipartParserHeaderState_DispositionType;
+                    return MultipartParserEvent_None;
+                case HEADER_CONTENT_TYPE:
+                    header->field = FIELD_CONTENT_TYPE;
+                    header->field_size = 0;
+                    header->state = MultipartParserHeaderState_ValueStart;
+                    return MultipartParserEvent_None;
+                case HEADER_CONTENT_TRANSFER_ENCODING:
+                    header->candidates = (1u << ENCODING_COUNT) - 1;
+                    header->name_size = 0;
+                    header->state = MultipartParserHeaderState_EncodingValue;
+                    return MultipartParserEvent_None;
+                default:
+                    header->state = MultipartParserHeaderState_SkipLine;
+                    return MultipartParserEvent_None;
+            }
+        }
+        case MultipartParserHeaderState_ValueStart:
+            if (is_space(c))
+            {
+                return MultipartParserEvent_None;
+            }
+            header->state = MultipartParserHeaderState_Value;
+            // fall through
+        case MultipartParserHeaderState_Value:
+            // Keep the media type only, parameters such as charset are dropped
+            if (c == ';' || is_space(c))
+            {
+                header->state = MultipartParserHeaderState_SkipLine;
+                return MultipartParserEvent_None;
+            }
+            part_info_add(context, c);
+            return MultipartParserEvent_None;
+        case MultipartParserHeaderState_DispositionType:
+            // e.g. 'form-data', not needed
+            if (c == ';')
+            {
+                header->state = MultipartParserHeaderState_ParamStart;
+            }
+            return MultipartParserEvent_None;
+        case MultipartParserHeaderState_ParamStart:
+            if (is_space(c) || c == ';')
+            {
+                return MultipartParserEvent_None;
+            }
+            header->candidates = (1u << PARAM_COUNT) - 1;
+            header->name_size = 0;
+            header->state = MultipartParserHeaderState_ParamName;
+            // fall through
+        case MultipartParserHeaderState_ParamName:
+            if (c == '=')
+            {
+                const int param = name_matched(param_names, PARAM_COUNT, header->candidates, header->name_size);
+                header->field = (param < 0) ? FIELD_NONE : (param == 0) ? FIELD_NAME : FIELD_FILENAME;
+                header->field_size = 0;
+                header->state = MultipartParserHeaderState_ParamValueStart;
+            }
+            else if (c == ';')
+            {
+                header->state = MultipartParserHeaderState_ParamStart;
+            }
+            else if (!is_space(c))
+            {
+                header->candidates = header->candidates ? name_match(param_names, PARAM_COUNT, header->candidates, header->name_size, c) : 0;
+                header->name_size = header->candidates ? header->name_size + 1 : header->name_size;
+            }
+            return MultipartParserEvent_None;
+        case MultipartParserHeaderState_ParamValueStart:
+            if (is_space(c))
+            {
+                return MultipartParserEvent_None;
+            }
+            if (c == '"')
+            {
+                header->state = MultipartParserHeaderState_ParamQuoted;
+                return MultipartParserEvent_None;
+            }
+            header->state = MultipartParserHeaderState_ParamToken;
+            // fall through
+        case MultipartParserHeaderState_ParamToken:
+            if (c == ';')
+            {
+                header->state = MultipartParserHeaderState_ParamStart;
+                return MultipartParserEvent_None;
+            }
+            if (is_space(c))
+            {
+                header->state = MultipartParserHeaderState_ParamNext;
+                return MultipartParserEvent_None;
+            }
+            part_info_add(context, c);
+            return MultipartParserEvent_None;
+        case MultipartParserHeaderState_ParamQuoted:
+            if (c == '"')
+            {
+                header->state = MultipartParserHeaderState_ParamNext;
+                return MultipartParserEvent_None;
+            }
+            if (c == '\\')
+            {
+                header->state = MultipartParserHeaderState_ParamQuotedEscape;
+                return MultipartParserEvent_None;
+            }
+            part_info_add(context, c);
+            return MultipartParserEvent_None;
+        case MultipartParserHeaderState_ParamQuotedEscape:
+            header->state = MultipartParserHeaderState_ParamQuoted;
+            part_info_add(context, c);
+            return MultipartParserEvent_None;
+        case MultipartParserHeaderState_ParamNext:
+            if (c == ';')
+            {
+                header->state = MultipartParserHeaderState_ParamStart;
+            }
+            return MultipartParserEvent_None;
+        case MultipartParserHeaderState_EncodingValue:
+        {
+            // Matched as it goes, so the encoding is known whichever way the line ends
+            if (is_space(c) || c == ';')
+            {
+                header->state = (header->name_size == 0) ? MultipartParserHeaderState_EncodingValue : MultipartParserHeaderState_SkipLine;
+                return MultipartParserEvent_None;
+            }
+            header->candidates = name_match(encoding_names, ENCODING_COUNT, header->candidates, header->name_size, c);
+            header->name_size = header->candidates ? header->name_size + 1 : header->name_size;
+            const int encoding = name_matched(encoding_names, ENCODING_COUNT, header->candidates, header->name_size);
+            context->transfer_encoding = (encoding < 0) ? MultipartParserTransferEncoding_Identity : (unsigned char)(encoding + 1);
+            header->state = header->candidates ? MultipartParserHeaderState_EncodingValue : MultipartParserHeaderState_SkipLine;
+            return MultipartParserEvent_None;
+        }
+        default:
+            // MultipartParserHeaderState_SkipLine
+            return MultipartParserEvent_None;
+    }
+}
+
+// Advance the delimiter match by one byte. Returns how many of the bytes held as a possible delimiter turned out not to be one.
+// The held bytes are always the start of the delimiter, so only their count is kept.
+// `\r\n--BOUNDARY` only has a '\r' at its very start (the boundary itself is printable), which makes its KMP failure function
+// zero everywhere. So on a mismatch no tail of the held bytes can start a delimiter and only `c` itself needs a second look,
+// meaning each byte is compared at most twice however the input is crafted.
+static inline unsigned int boundary_match_next(MinimalMultipartParserContext *context, const char c)
+{
+    const char *full_boundary_string = context_delimiter(context);
+    const unsigned int matched = context->boundary_match;
+    if (c == full_boundary_string[matched])
+    {
+        context->boundary_match++;
+        return 0;
+    }
+
+    context->boundary_match = (c == full_boundary_string[0]) ? 1 : 0;
+    return matched;
+}
+
+// Each phase of the state machine below is a block that always returns. By default the blocks are tried in turn, which keeps the
+// code small. With MINIMAL_MULTIPART_PARSER_ENABLE_COMPUTED_GOTO on GCC or Clang each block is a label instead, and the current
+// phase is jumped to through a table of label addresses (a GNU extension), so the hot phases do not pay for the ones before them.
+#if defined(MINIMAL_MULTIPART_PARSER_ENABLE_COMPUTED_GOTO) && defined(__GNUC__)
+#define PHASE_DISPATCH_GOTO
+#define PHASE(name) phase_##name:
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#pragma GCC diagnostic ignored "-Wunused-label"
+#else
+#define PHASE(name) if (context->phase == MultipartParserPhase_##name)
+#endif
+
+static inline MultipartParserEvent process_char(MinimalMultipartParserContext *context, const char c)
+{
+#ifdef MINIMAL_MULTIPART_PARSER_BOUNDARY_DISCOVERY
+    MinimalMultipartParserCharBuffer *boundaryBuffer = &(context->boundary.string);
+#endif
+#ifndef MINIMAL_MULTIPART_PARSER_COMPACT_CONTEXT
+    MinimalMultipartParserCharBuffer *dataBuffer = &(context->data);
+#endif
+
+    data_release(context);
+    STATS_ADD(context, phase_bytes[context->phase], 1);
+    STATS_ADD(context, bytes_inspected, 1);
+
+    // Preamble and part headers are only ever taken a byte at a time, part bodies are counted as they are released
+    if (context->limits)
+    {
+        if (context->phase <= MultipartParserPhase_GetBoundary_Done && !section_add(context, 1, context->limits->preamble_bytes))
+        {
+            return limit_exceeded(context);
+        }
+        if (context->phase == MultipartParserPhase_SkipFileHeader && !section_add(context, 1, context->limits->header_bytes))
+        {
+            return limit_exceeded(context);
+        }
+    }
+
+#ifdef PHASE_DISPATCH_GOTO
+    // Jump straight to the current phase instead of testing each phase in turn
+    static const void *const phase_dispatch[] = {
+#ifndef MINIMAL_MULTIPART_PARSER_BOUNDARY_DISCOVERY
+#ifdef MINIMAL_MULTIPART_PARSER_FIXED_BOUNDARY
+        [MultipartParserPhase_INIT] = &&phase_INIT,
+#else
+        [MultipartParserPhase_INIT] = &&phase_none,
+#endif
+        [MultipartParserPhase_Preamble_SKIP_LINE] = &&phase_none,
+        [MultipartParserPhase_Preamble_CR] = &&phase_none,
+        [MultipartParserPhase_Preamble_LF] = &&phase_none,
+        [MultipartParserPhase_Preamble_HYPHEN] = &&phase_none,
+        [MultipartParserPhase_GetBoundary] = &&phase_none,
+        [MultipartParserPhase_GetBoundary_Done] = &&phase_none,
+#else
+        [MultipartParserPhase_INIT] = &&phase_INIT,
+        [MultipartParserPhase_Preamble_SKIP_LINE] = &&phase_Preamble_SKIP_LINE,
+        [MultipartParserPhase_Preamble_CR] = &&phase_Preamble_CR,
+        [MultipartParserPhase_Preamble_LF] = &&phase_Preamble_LF,
+        [MultipartParserPhase_Preamble_HYPHEN] = &&phase_Preamble_HYPHEN,
+        [MultipartParserPhase_GetBoundary] = &&phase_GetBoundary,
+        [MultipartParserPhase_GetBoundary_Done] = &&phase_GetBoundary_Done,
+#endif
+        [MultipartParserPhase_Preamble_SeekBoundary] = &&phase_Preamble_SeekBoundary,
+        [MultipartParserPhase_SkipFileHeader] = &&phase_SkipFileHeader,
+        [MultipartParserPhase_GetFileBytes] = &&phase_GetFileBytes,
+        [MultipartParserPhase_SkipFileBytes] = &&phase_SkipFileBytes,
+        [MultipartParserPhase_EndOfFile] = &&phase_EndOfFile,
+        [MultipartParserPhase_EndOfFile_CR] = &&phase_EndOfFile_CR,
+        [MultipartParserPhase_EndOfFile_HYPHEN] = &&phase_EndOfFile_HYPHEN,
+        [MultipartParserPhase_Epilogue] = &&phase_Epilogue,
+        [MultipartParserPhase_LimitExceeded] = &&phase_none,
+    };
+    goto *phase_dispatch[context->phase];
+#endif
+
+#ifdef MINIMAL_MULTIPART_PARSER_BOUNDARY_DISCOVERY
+    // Boundary discovery writes the boundary into the context, which a compact context cannot do
+    PHASE(INIT)
+    {
+        switch (c)
+        {
+            case '\r':
+                context->phase = MultipartParserPhase_Preamble_CR;
+                return MultipartParserEvent_None;
+            case '-':
+                context->phase = MultipartParserPhase_Preamble_HYPHEN;
+                return MultipartParserEvent_None;
+            default:
+                context->phase = MultipartParserPhase_Preamble_SKIP_LINE;
+                return MultipartParserEvent_None;
+        }
+    }
+
+    PHASE(Preamble_SKIP_LINE)
+    {
+        switch (c)
+        {
+            case '\r':
+                context->phase = MultipartParserPhase_Preamble_CR;
+                return MultipartParserEvent_None;
+            case '\n':
+                context->phase = MultipartParserPhase_Preamble_LF;
+                return MultipartParserEvent_None;
+            default:
+                return MultipartParserEvent_None;
+        }
+    }
+
+    PHASE(Preamble_CR)
+    {
+        switch (c)
+        {
+            case '\n':
+                context->phase = MultipartParserPhase_Preamble_LF;
+                return MultipartParserEvent_None;
+            default:
+                context->phase = MultipartParserPhase_Preamble_SKIP_LINE;
+                return MultipartParserEvent_None;
+        }
+    }
+
+    PHASE(Preamble_LF)
+    {
+        switch (c)
+        {
+            case '-':
+                context->phase = MultipartParserPhase_Preamble_HYPHEN;
+                return MultipartParserEvent_None;
+            default:
+                context->phase = MultipartParserPhase_Preamble_SKIP_LINE;
+                return MultipartParserEvent_None;
+        }
+    }
+
+    PHASE(Preamble_HYPHEN)
+    {
+        // Previously got a dash in '\r\n--', seeking another dash
+        switch (c)
+        {
+            case '-':
+                context->phase = MultipartParserPhase_GetBoundary;
+                buffer_add(boundaryBuffer, '\r');
+                buffer_add(boundaryBuffer, '\n');
+                buffer_add(boundaryBuffer, '-');
+                buffer_add(boundaryBuffer, '-');
+                return MultipartParserEvent_None;
+            default:
+                context->phase = MultipartParserPhase_Preamble_SKIP_LINE;
+                return MultipartParserEvent_None;
+        }
+    }
+#elif defined(MINIMAL_MULTIPART_PARSER_FIXED_BOUNDARY)
+    PHASE(INIT)
+    {
+        // Zeroed context, set up like minimal_multipart_parser_reset() does and fall through to take `c` as preamble.
+        // The body may open with the first delimiter without a CRLF in front of it, so act as if we just got one
+        context->boundary_match = 2;
+        context->phase = MultipartParserPhase_Preamble_SeekBoundary;
+    }
+#endif
+
+    PHASE(Preamble_SeekBoundary)
+    {
+        // Boundary was given up front, so just look for the first delimiter and discard everything before it
+        boundary_match_next(context, c);
+        if (context->boundary_match >= context_delimiter_count(context))
+        {
+            // Read the rest of the delimiter line like we do after each file
+            context->phase = MultipartParserPhase_EndOfFile;
+            context->boundary_match = 0;
+        }
+        return MultipartParserEvent_None;
+    }
+
+#ifdef MINIMAL_MULTIPART_PARSER_BOUNDARY_DISCOVERY
+    PHASE(GetBoundary)
+    {
+        switch (c)
+        {
+            case '\r':
+                context->phase = MultipartParserPhase_GetBoundary_Done;
+                return MultipartParserEvent_None;
+            default:
+                if ((c < ' ') || ('~' < c))
+                {
+                    context->phase = MultipartParserPhase_Preamble_SKIP_LINE;
+                    buffer_reset(boundaryBuffer);
+                    return MultipartParserEvent_None;
+                }
+                if (!buffer_add(boundaryBuffer, c))
+                {
+                    context->phase = MultipartParserPhase_Preamble_SKIP_LINE;
+                    buffer_reset(boundaryBuffer);
+                    return MultipartParserEvent_None;
+                }
+                return MultipartParserEvent_None;
+        }
+    }
+
+    PHASE(GetBoundary_Done)
+    {
+        switch (c)
+        {
+            case '\n':
+                context->phase = MultipartParserPhase_SkipFileHeader;
+                boundary_compile(&(context->boundary));
+                return part_found(context);
+            default:
+                context->phase = MultipartParserPhase_Preamble_SKIP_LINE;
+                buffer_reset(boundaryBuffer);
+                return MultipartParserEvent_None;
+        }
+    }
+#endif
+
+    PHASE(SkipFileHeader)
+    {
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_STATS
+        if (++context->stats.header_size > context->stats.max_header_size)
+        {
+            context->stats.max_header_size = context->stats.header_size;
+        }
+#endif
+        return header_process(context, c);
+    }
+
+    PHASE(GetFileBytes)
+    {
+        const unsigned int released = boundary_match_next(context, c);
+
+        if (context->boundary_match >= context_delimiter_count(context))
+        {
+            context->phase = MultipartParserPhase_EndOfFile;
+            context->parts_completed++;
+            context->boundary_match = 0;
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_DIGEST
+            if (context->digest.enabled)
+            {
+                digest_finish(&(context->digest));
+            }
+#endif
+            return MultipartParserEvent_DataStreamCompleted;
+        }
+
+#ifndef MINIMAL_MULTIPART_PARSER_COMPACT_CONTEXT
+        // Only reached from the per char api, process_buffer() hands back the held bytes before it gets a mismatching byte
+        if (context->boundary_match == 0)
+        {
+            // `c` is file data as well, so it has to be copied in after the released start of the delimiter
+            STATS_ADD(context, boundary_restarts, released > 0 ? 1 : 0);
+            buffer_reset(dataBuffer);
+            for (unsigned int i = 0; i < released; i++)
+            {
+                buffer_add(dataBuffer, context_delimiter(context)[i]);
+            }
+            buffer_add(dataBuffer, c);
+            return data_emit(context, dataBuffer->buffer, buffer_count(dataBuffer));
+        }
+#endif
+
+        if (released > 0)
+        {
+            // Held bytes are always the start of the delimiter, so no copy is needed
+            STATS_ADD(context, boundary_restarts, 1);
+            return data_emit(context, context_delimiter(context), released);
+        }
+
+        return MultipartParserEvent_None;
+    }
+
+    PHASE(SkipFileBytes)
+    {
+        // As above, but nothing is handed over. Held bytes are dropped along with the rest of the body
+        const unsigned int released = boundary_match_next(context, c);
+        if (context->boundary_match >= context_delimiter_count(context))
+        {
+            context->phase = MultipartParserPhase_EndOfFile;
+            context->parts_skipped++;
+            context->boundary_match = 0;
+            return MultipartParserEvent_None;
+        }
+
+        // Count body bytes as a kept part would have them emitted, so skipping a part never trips a limit keeping it would not
+        const unsigned int body = released + (context->boundary_match == 0 ? 1 : 0);
+        if (context->limits && !section_add(context, body, context->limits->part_bytes))
+        {
+            return limit_exceeded(context);
+        }
+        return MultipartParserEvent_None;
+    }
+
+    PHASE(EndOfFile)
+    {
+        // Got '\r\n--BOUNDARY', the next two chars tell us if another part follows ('\r\n') or if this was the last one ('--')
+        switch (c)
+        {
+            case '\r':
+                context->phase = MultipartParserPhase_EndOfFile_CR;
+                return MultipartParserEvent_None;
+            case '-':
+                context->phase = MultipartParserPhase_EndOfFile_HYPHEN;
+                return MultipartParserEvent_None;
+            default:
+                // Transport padding
+                return MultipartParserEvent_None;
+        }
+    }
+
+    PHASE(EndOfFile_CR)
+    {
+        switch (c)
+        {
+            case '\n':
+                context->phase = MultipartParserPhase_SkipFileHeader;
+                return part_found(context);
+            default:
+                context->phase = MultipartParserPhase_EndOfFile;
+                return MultipartParserEvent_None;
+        }
+    }
+
+    PHASE(EndOfFile_HYPHEN)
+    {
+        switch (c)
+        {
+            case '-':
+                context->phase = MultipartParserPhase_Epilogue;
+                return MultipartParserEvent_MultipartStreamCompleted;
+            default:
+                context->phase = MultipartParserPhase_EndOfFile;
+                return MultipartParserEvent_None;
+        }
+    }
+
+    PHASE(Epilogue)
+    {
+        // Do nothing... Anything after the close delimiter is to be ignored
+        return MultipartParserEvent_None;
+    }
+
+#ifdef PHASE_DISPATCH_GOTO
+phase_none:
+#endif
+    return MultipartParserEvent_None;
+}
+#ifdef PHASE_DISPATCH_GOTO
+#pragma GCC diagnostic pop
+#endif
+
+MultipartParserEvent minimal_multipart_parser_process(MinimalMultipartParserContext *context, const char c) { return stats_event(context, process_char(context, c)); }
+
+static inline MultipartParserEvent process_chunk(MinimalMultipartParserContext *context, const char *buffer, const size_t size, size_t *consumed)
+{
+    // Run the state machine over the whole chunk, only handing control back to the caller when an event fires
+    for (size_t i = 0; i < size && context->phase != MultipartParserPhase_LimitExceeded; i++)
+    {
+        if (context->phase == MultipartParserPhase_GetFileBytes)
+        {
+            data_release(context);
+            if (context->boundary_match == 0)
+            {
+                // Not midway through a boundary match, so every byte up to the next possible boundary start is
+                // file data. Hand it over as a view into the caller's buffer instead of one event per byte.
+                const size_t max_run = (size - i) < (unsigned int)~0u ? (size - i) : (unsigned int)~0u;
+                ScanCounts counts = {0, 0};
+                const size_t run = scan_for_boundary(context, &buffer[i], max_run, &counts);
+                STATS_ADD(context, boundary_restarts, counts.rejected);
+                STATS_ADD(context, bytes_inspected, counts.inspected);
+
+                if (run > 0)
+                {
+                    STATS_ADD(context, phase_bytes[MultipartParserPhase_GetFileBytes], run);
+                    *consumed = i + run;
+                    return data_emit(context, &buffer[i], (unsigned int)run);
+                }
+            }
+            else if (buffer[i] != context_delimiter(context)[context->boundary_match])
+            {
+                // Partial delimiter was file data after all. Hand back the held bytes, which are the start of the delimiter
+                // string so need no copy, and leave this byte unconsumed to be looked at again as the start of the next run.
+                const unsigned int held = context->boundary_match;
+                context->boundary_match = 0;
+                STATS_ADD(context, boundary_restarts, 1);
+                *consumed = i;
+                return data_emit(context, context_delimiter(context), held);
+            }
+        }
+        else if (context->phase == MultipartParserPhase_SkipFileBytes && context->boundary_match == 0)
+        {
+            // Skipped part body is thrown away like the preamble
+            ScanCounts counts = {0, 0};
+            const size_t skipped = scan_for_boundary(context, &buffer[i], size - i, &counts);
+            STATS_ADD(context, bytes_inspected, counts.inspected);
+            STATS_ADD(context, phase_bytes[MultipartParserPhase_SkipFileBytes], skipped);
+            if (context->limits && !section_add(context, skipped, context->limits->part_bytes))
+            {
+                *consumed = i + skipped;
+                return limit_exceeded(context);
+            }
+            i += skipped;
+            if (i >= size)
+            {
+                break;
+            }
+        }
+        else if (context->phase == MultipartParserPhase_Preamble_SeekBoundary && context->boundary_match == 0)
+        {
+            // Preamble is thrown away, so jump straight to the first possible delimiter
+            ScanCounts counts = {0, 0};
+            const size_t skipped = scan_for_boundary(context, &buffer[i], size - i, &counts);
+            STATS_ADD(context, bytes_inspected, counts.inspected);
+            STATS_ADD(context, phase_bytes[MultipartParserPhase_Preamble_SeekBoundary], skipped);
+            if (context->limits && !section_add(context, skipped, context->limits->preamble_bytes))
+            {
+                *consumed = i + skipped;
+                return limit_exceeded(context);
+            }
+            i += skipped;
+            if (i >= size)
+            {
+                break;
+            }
+        }
+
+        const MultipartParserEvent event = process_char(context, buffer[i]);
+        if (event != MultipartParserEvent_None)
+        {
+            *consumed = i + 1;
+            return event;
+        }
+    }
+
+    *consumed = size;
+    return MultipartParserEvent_None;
+}
+
+MultipartParserEvent minimal_multipart_parser_process_buffer(MinimalMultipartParserContext *context, const char *buffer, const size_t size, size_t *consumed)
+{
+    return stats_event(context, process_chunk(context, buffer, size, consumed));
+}
+
+// Shell style glob with `*` and `?`. A `*` only ever has to be retried from one place: the most recent one
+static bool glob_match(const char *pattern, const char *string)
+{
+    const char *star = NULL;
+    const char *star_string = NULL;
+    while (*string != '\0')
+    {
+        if (*pattern == '*')
+        {
+            star = ++pattern;
+            star_string = string;
+        }
+        else if (*pattern == '?' || *pattern == *string)
+        {
+            pattern++;
+            string++;
+        }
+        else if (star)
+        {
+            pattern = star;
+            string = ++star_string;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    while (*pattern == '*')
+    {
+        pattern++;
+    }
+    return *pattern == '\0';
+}
+
+bool minimal_multipart_parser_filter_match(const MinimalMultipartParserFilter *filter, const MinimalMultipartParserContext *context)
+{
+    const char *name = minimal_multipart_parser_get_part_name(context);
+    for (unsigned int i = 0; i < filter->name_count; i++)
+    {
+        const char *a = filter->names[i];
+        const char *b = name;
+        while (*a != '\0' && *a == *b)
+        {
+            a++;
+            b++;
+        }
+        if (*a == *b)
+        {
+            return true;
+        }
+    }
+
+    // A part without a filename is not a file, so no glob (not even `*`) picks it
+    const char *filename = minimal_multipart_parser_get_part_filename(context);
+    for (unsigned int i = 0; filename[0] != '\0' && i < filter->filename_count; i++)
+    {
+        if (glob_match(filter->filenames[i], filename))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void minimal_multipart_parser_skip_part(MinimalMultipartParserContext *context)
+{
+    if (context->phase == MultipartParserPhase_GetFileBytes)
+    {
+        data_release(context);
+        context->phase = MultipartParserPhase_SkipFileBytes;
+    }
+}
+
+size_t minimal_multipart_parser_find_delimiter(const MinimalMultipartParserContext *context, const char *buffer, const size_t size)
+{
+    // Nothing to look for until the boundary is complete
+    if (!context_boundary_known(context))
+    {
+        return size;
+    }
+
+    // Scanner also stops at a partial delimiter at the very end, which is not a match here
+    const size_t count = context_delimiter_count(context);
+    ScanCounts counts = {0, 0};
+    const size_t i = scan_for_boundary(context, buffer, size, &counts);
+    return (i + count <= size) ? i : size;
+}
+
+void minimal_multipart_parser_sink_flush(MinimalMultipartParserSink *sink)
+{
+    if (sink->buffer_count > 0 && sink->on_data)
+    {
+        sink->on_data(sink->user_data, sink->buffer, sink->buffer_count);
+    }
+    sink->buffer_count = 0;
+}
+
+static void sink_write(MinimalMultipartParserSink *sink, const char *data, const size_t size)
+{
+    if (sink->buffer_size - sink->buffer_count < size)
+    {
+        minimal_multipart_parser_sink_flush(sink);
+    }
+
+    if (size >= sink->buffer_size)
+    {
+        // Would not gain anything from the copy (or there is no scratch buffer), so pass the view straight through
+        if (sink->on_data)
+        {
+            sink->on_data(sink->user_data, data, size);
+        }
+        return;
+    }
+
+    char *destination = &(sink->buffer[sink->buffer_count]);
+    for (size_t i = 0; i < size; i++)
+    {
+        destination[i] = data[i];
+    }
+    sink->buffer_count += size;
+}
+
+// Most bytes a single decode step writes, which is the vector base64 block's 16 byte store
+#define DECODE_STEP_MAX_OUT (16)
+
+// Below this the sink buffer is too small to decode into, so a stack buffer is used instead
+#define DECODE_MIN_SINK_BUFFER (64)
+
+#if defined(MINIMAL_MULTIPART_PARSER_SIMD_SCANNER) && defined(__x86_64__)
+// Muła and Lemire's SSSE3 base64 decoder. Turns 16 base64 chars into 12 bytes, storing 16 (the last 4 are junk).
+// Returns false without storing anything if any of the 16 is not a base64 char (e.g. a line break or padding).
+__attribute__((target("ssse3"))) static bool base64_block_ssse3(const char *in, char *out)
+{
+    const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask_2f = _mm_set1_epi8(0x2f);
+
+    __m128i str = _mm_loadu_si128((const __m128i *)in);
+    const __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask_2f);
+    const __m128i lo_nibbles = _mm_and_si128(str, mask_2f);
+    const __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+    const __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+    if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0)
+    {
+        return false;
+    }
+
+    // Map each char to its 6 bit value, then pack four 6 bit values into each 3 bytes
+    const __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(_mm_cmpeq_epi8(str, mask_2f), hi_nibbles));
+    str = _mm_add_epi8(str, roll);
+    const __m128i merged = _mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140));
+    const __m128i packed = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+    _mm_storeu_si128((__m128i *)out, _mm_shuffle_epi8(packed, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1)));
+    return true;
+}
+
+static bool cpu_has_ssse3(void)
+{
+#ifdef __SSSE3__
+    return true;
+#else
+    static int has_ssse3 = -1;
+    if (has_ssse3 < 0)
+    {
+        __builtin_cpu_init();
+        has_ssse3 = __builtin_cpu_supports("ssse3") ? 1 : 0;
+    }
+    return has_ssse3;
+#endif
+}
+#endif
+
+static inline int base64_value(const char c)
+{
+    if (c >= 'A' && c <= 'Z')
+    {
+        return c - 'A';
+    }
+    if (c >= 'a' && c <= 'z')
+    {
+        return c - 'a' + 26;
+    }
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0' + 52;
+    }
+    return (c == '+') ? 62 : (c == '/') ? 63 : -1;
+}
+
+static inline int hex_value(const char c)
+{
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    const char lower = ascii_lower(c);
+    return (lower >= 'a' && lower <= 'f') ? lower - 'a' + 10 : -1;
+}
+
+// Output the bytes of a quad cut short by padding or the end of the part, then start a new quad
+static size_t base64_finish(MinimalMultipartParserSink *sink, char *out)
+{
+    const unsigned int bits = sink->decode_bits;
+    size_t count = 0;
+    if (sink->decode_count == 2)
+    {
+        out[count++] = (char)(bits >> 4);
+    }
+    else if (sink->decode_count == 3)
+    {
+        out[count++] = (char)(bits >> 10);
+        out[count++] = (char)(bits >> 2);
+    }
+    sink->decode_bits = 0;
+    sink->decode_count = 0;
+    return count;
+}
+
+// Decode as much of `in` as fits in `out`. Line breaks and anything else outside the base64 alphabet are skipped.
+static size_t base64_decode(MinimalMultipartParserSink *sink, const char *in, const size_t in_size, size_t *in_used, char *out, const size_t out_size)
+{
+    size_t i = 0;
+    size_t count = 0;
+    while (i < in_size && count + DECODE_STEP_MAX_OUT <= out_size)
+    {
+#if defined(MINIMAL_MULTIPART_PARSER_SIMD_SCANNER) && defined(__x86_64__)
+        if (sink->decode_count == 0 && in_size - i >= 16 && cpu_has_ssse3() && base64_block_ssse3(&in[i], &out[count]))
+        {
+            i += 16;
+            count += 12;
+            continue;
+        }
+#endif
+        const char c = in[i++];
+        const int value = base64_value(c);
+        if (value >= 0)
+        {
+            sink->decode_bits = (sink->decode_bits << 6) | (unsigned int)value;
+            if (++sink->decode_count == 4)
+            {
+                out[count++] = (char)(sink->decode_bits >> 16);
+                out[count++] = (char)(sink->decode_bits >> 8);
+                out[count++] = (char)sink->decode_bits;
+                sink->decode_bits = 0;
+                sink->decode_count = 0;
+            }
+        }
+        else if (c == '=')
+        {
+            count += base64_finish(sink, &out[count]);
+        }
+    }
+    *in_used = i;
+    return count;
+}
+
+// Quoted-printable escape state kept in decode_count
+enum
+{
+    QP_TEXT,
+    QP_EQUALS,     // Got '='
+    QP_HEX,        // Got '=' and one hex digit, which is kept in decode_bits
+    QP_SOFT_BREAK  // Got '=' and '\r'
+};
+
+// Output an escape cut short by a bad char or the end of the part as it was sent
+static size_t quoted_printable_finish(MinimalMultipartParserSink *sink, char *out)
+{
+    size_t count = 0;
+    if (sink->decode_count == QP_EQUALS || sink->decode_count == QP_HEX)
+    {
+        out[count++] = '=';
+    }
+    if (sink->decode_count == QP_HEX)
+    {
+        out[count++] = (char)sink->decode_bits;
+    }
+    sink->decode_bits = 0;
+    sink->decode_count = QP_TEXT;
+    return count;
+}
+
+// Decode as much of `in` as fits in `out`. `=XX` escapes become the byte and `=` line endings (soft line breaks) are dropped.
+static size_t quoted_printable_decode(MinimalMultipartParserSink *sink, const char *in, const size_t in_size, size_t *in_used, char *out, const size_t out_size)
+{
+    size_t i = 0;
+    size_t count = 0;
+    while (i < in_size && count + DECODE_STEP_MAX_OUT <= out_size)
+    {
+        const char c = in[i++];
+        switch (sink->decode_count)
+        {
+            case QP_TEXT:
+                if (c == '=')
+                {
+                    sink->decode_count = QP_EQUALS;
+                }
+                else
+                {
+                    out[count++] = c;
+                }
+                break;
+            case QP_EQUALS:
+                if (hex_value(c) >= 0)
+                {
+                    sink->decode_bits = (unsigned char)c;
+                    sink->decode_count = QP_HEX;
+                }
+                else if (c == '\r')
+                {
+                    sink->decode_count = QP_SOFT_BREAK;
+                }
+                else if (c == '\n')
+                {
+                    sink->decode_count = QP_TEXT;
+                }
+                else
+                {
+                    // Not an escape, keep it as sent and look at this char again as text
+                    count += quoted_printable_finish(sink, &out[count]);
+                    i--;
+                }
+                break;
+            case QP_HEX:
+                if (hex_value(c) >= 0)
+                {
+                    out[count++] = (char)((hex_value((char)sink->decode_bits) << 4) | hex_value(c));
+                    sink->decode_bits = 0;
+                    sink->decode_count = QP_TEXT;
+                }
+                else
+                {
+                    count += quoted_printable_finish(sink, &out[count]);
+                    i--;
+                }
+                break;
+            default:
+                // QP_SOFT_BREAK, the '\n' ends it. Anything else is taken as text after a bare '=\r'
+                sink->decode_count = QP_TEXT;
+                if (c != '\n')
+                {
+                    i--;
+                }
+                break;
+        }
+    }
+    *in_used = i;
+    return count;
+}
+
+static void sink_decode(MinimalMultipartParserSink *sink, const unsigned char encoding, const char *data, const size_t size)
+{
+    char local[256];
+    const bool direct = sink->buffer && sink->buffer_size >= DECODE_MIN_SINK_BUFFER;
+    for (size_t used = 0; used < size;)
+    {
+        if (direct && sink->buffer_size - sink->buffer_count < DECODE_STEP_MAX_OUT)
+        {
+            minimal_multipart_parser_sink_flush(sink);
+        }
+
+        // Decoded bytes go straight into the batching buffer, as the raw bytes would have been copied into it anyway
+        char *out = direct ? &(sink->buffer[sink->buffer_count]) : local;
+        const size_t out_size = direct ? sink->buffer_size - sink->buffer_count : sizeof(local);
+        size_t in_used = 0;
+        size_t count = 0;
+        if (encoding == MultipartParserTransferEncoding_Base64)
+        {
+            count = base64_decode(sink, &data[used], size - used, &in_used, out, out_size);
+        }
+        else
+        {
+            count = quoted_printable_decode(sink, &data[used], size - used, &in_used, out, out_size);
+        }
+        used += in_used;
+
+        if (direct)
+        {
+            sink->buffer_count += count;
+        }
+        else if (count > 0)
+        {
+            sink_write(sink, local, count);
+        }
+    }
+}
+
+// Part is over, so output whatever the decoder still holds
+static void sink_decode_finish(MinimalMultipartParserSink *sink, const unsigned char encoding)
+{
+    char out[DECODE_STEP_MAX_OUT];
+    const size_t count = (encoding == MultipartParserTransferEncoding_Base64) ? base64_finish(sink, out) : quoted_printable_finish(sink, out);
+    if (count > 0)
+    {
+        sink_write(sink, out, count);
+    }
+}
+
+size_t minimal_multipart_parser_process_sink(MinimalMultipartParserContext *context, MinimalMultipartParserSink *sink, const char *buffer, const size_t size)
+{
+    size_t offset = 0;
+    sink->paused = false;
+    while (offset < size && !sink->paused)
+    {
+        size_t consumed = 0;
+        const MultipartParserEvent event = minimal_multipart_parser_process_buffer(context, &buffer[offset], size - offset, &consumed);
+        offset += consumed;
+
+        switch (event)
+        {
+            case MultipartParserEvent_FileStreamStarting:
+                if (sink->filter && !minimal_multipart_parser_filter_match(sink->filter, context))
+                {
+                    minimal_multipart_parser_skip_part(context);
+                    break;
+                }
+                sink->decode_bits = 0;
+                sink->decode_count = 0;
+                if (sink->on_part_begin)
+                {
+                    sink->on_part_begin(sink->user_data, context);
+                }
+                break;
+            case MultipartParserEvent_DataBufferAvailable:
+                if (sink->decode && context->transfer_encoding != MultipartParserTransferEncoding_Identity)
+                {
+                    sink_decode(sink, context->transfer_encoding, minimal_multipart_parser_get_data_buffer(context), minimal_multipart_parser_get_data_size(context));
+                }
+                else
+                {
+                    sink_write(sink, minimal_multipart_parser_get_data_buffer(context), minimal_multipart_parser_get_data_size(context));
+                }
+                break;
+            case MultipartParserEvent_LimitExceeded:
+                // Caller is expected to drop the connection, so there is no point passing on what was gathered
+                sink->buffer_count = 0;
+                return offset;
+            case MultipartParserEvent_DataStreamCompleted:
+                if (sink->decode && context->transfer_encoding != MultipartParserTransferEncoding_Identity)
+                {
+                    sink_decode_finish(sink, context->transfer_encoding);
+                }
+                minimal_multipart_parser_sink_flush(sink);
+                if (sink->on_part_end)
+                {
+                    sink->on_part_end(sink->user_data, context);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    return offset;
+}
+
+bool minimal_multipart_parser_boundary_init(MinimalMultipartParserBoundary *boundary, const char *boundary_string, const size_t size)
+{
+    // RFC 2046 limits the boundary to 70 printable chars
+    if (size == 0 || size > MINIMAL_MULTIPART_PARSER_USER_BOUNDARY_SIZE)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < size; i++)
+    {
+        if ((boundary_string[i] < ' ') || ('~' < boundary_string[i]))
+        {
+            return false;
+        }
+    }
+
+    MinimalMultipartParserCharBuffer *boundaryBuffer = &(boundary->string);
+    buffer_reset(boundaryBuffer);
+    buffer_add(boundaryBuffer, '\r');
+    buffer_add(boundaryBuffer, '\n');
+    buffer_add(boundaryBuffer, '-');
+    buffer_add(boundaryBuffer, '-');
+    for (size_t i = 0; i < size; i++)
+    {
+        buffer_add(boundaryBuffer, boundary_string[i]);
+    }
+    boundary_compile(boundary);
+    return true;
+}
+
+// Finds the boundary parameter in e.g. `multipart/form-data; boundary="AaB03x"`, setting where its value starts and ends
+static bool content_type_boundary(const char *content_type, const size_t size, size_t *boundary_start, size_t *boundary_end)
+{
+    static const char boundary_param[] = "boundary=";
+    const size_t boundary_param_size = sizeof(boundary_param) - 1;
+
+    bool quoted = false;
+    for (size_t i = 0; i < size; i++)
+    {
+        if (quoted)
+        {
+            quoted = (content_type[i] != '"');
+            continue;
+        }
+
+        if (content_type[i] == '"')
+        {
+            quoted = true;
+            continue;
+        }
+
+        if (content_type[i] != ';')
+        {
+            continue;
+        }
+
+        size_t start = i + 1;
+        while (start < size && is_space(content_type[start]))
+        {
+            start++;
+        }
+
+        bool is_boundary_param = (size - start) > boundary_param_size;
+        for (size_t j = 0; is_boundary_param && j < boundary_param_size; j++)
+        {
+            is_boundary_param = ascii_lower(content_type[start + j]) == boundary_param[j];
+        }
+
+        if (!is_boundary_param)
+        {
+            continue;
+        }
+
+        start += boundary_param_size;
+        size_t end = start;
+        if (content_type[start] == '"')
+        {
+            start++;
+            end = start;
+            while (end < size && content_type[end] != '"')
+            {
+                end++;
+            }
+        }
+        else
+        {
+            while (end < size && content_type[end] != ';' && !is_space(content_type[end]))
+            {
+                end++;
+            }
+        }
+
+        *boundary_start = start;
+        *boundary_end = end;
+        return true;
+    }
+
+    return false;
+}
+
+bool minimal_multipart_parser_boundary_from_content_type(MinimalMultipartParserBoundary *boundary, const char *content_type, const size_t size)
+{
+    size_t start = 0;
+    size_t end = 0;
+    return content_type_boundary(content_type, size, &start, &end) && minimal_multipart_parser_boundary_init(boundary, &content_type[start], end - start);
+}
+
+// Checkpoint blobs are written byte by byte in little endian order, so they read back the same on any platform and build
+#define CHECKPOINT_MAGIC "MMPC"
+#define CHECKPOINT_VERSION (2)
+#define CHECKPOINT_FLAG_BOUNDARY_COMPILED (1u << 0)
+#define CHECKPOINT_FLAG_DIGEST (1u << 1)
+#define CHECKPOINT_FLAG_SINK (1u << 2)
+
+typedef struct CheckpointWriter
+{
+    unsigned char *out;
+    size_t size;
+    size_t count; // May run past `size`, in which case nothing past it was written
+    unsigned long hash;
+} CheckpointWriter;
+
+typedef struct CheckpointReader
+{
+    const unsigned char *in;
+    size_t size;
+    size_t count;
+    bool ok;
+    unsigned long hash;
+} CheckpointReader;
+
+// FNV-1a, to catch blobs damaged in storage
+static inline unsigned long checkpoint_hash(const unsigned long hash, const unsigned char byte) { return ((hash ^ byte) * 16777619ul) & 0xFFFFFFFFul; }
+
+static void checkpoint_put(CheckpointWriter *writer, const unsigned long long value, const unsigned int bytes)
+{
+    for (unsigned int i = 0; i < bytes; i++)
+    {
+        const unsigned char byte = (unsigned char)(value >> (8 * i));
+        if (writer->count < writer->size)
+        {
+            writer->out[writer->count] = byte;
+        }
+        writer->count++;
+        writer->hash = checkpoint_hash(writer->hash, byte);
+    }
+}
+
+static void checkpoint_put_string(CheckpointWriter *writer, const char *string, const size_t max_size)
+{
+    size_t size = 0;
+    while (size < max_size && string[size] != '\0')
+    {
+        size++;
+    }
+    checkpoint_put(writer, size, 1);
+    for (size_t i = 0; i < size; i++)
+    {
+        checkpoint_put(writer, (unsigned char)string[i], 1);
+    }
+}
+
+static unsigned long long checkpoint_get(CheckpointReader *reader, const unsigned int bytes)
+{
+    if (reader->count + bytes > reader->size)
+    {
+        reader->ok = false;
+        return 0;
+    }
+    unsigned long long value = 0;
+    for (unsigned int i = 0; i < bytes; i++)
+    {
+        const unsigned char byte = reader->in[reader->count++];
+        value |= (unsigned long long)byte << (8 * i);
+        reader->hash = checkpoint_hash(reader->hash, byte);
+    }
+    return value;
+}
+
+// Reads a string written by checkpoint_put_string() into `string` (NULL to skip it), truncated to what fits in `max_size` chars
+static void checkpoint_get_string(CheckpointReader *reader, char *string, const size_t max_size)
+{
+    const size_t size = (size_t)checkpoint_get(reader, 1);
+    size_t kept = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+        const char c = (char)checkpoint_get(reader, 1);
+        if (string && kept < max_size)
+        {
+            string[kept++] = c;
+        }
+    }
+    if (string)
+    {
+        string[kept] = '\0';
+    }
+}
+
+// Could header_process() have left the header parser like this? The candidate bitmask and name size index the name tables and
+// the field size the part info, so a forged blob that passes the hash must not be able to point them past the end
+static bool checkpoint_header_valid(const MinimalMultipartParserHeaderParser *header)
+{
+    static const unsigned int field_max[] = {0, MINIMAL_MULTIPART_PARSER_PART_NAME_MAX_CHAR, MINIMAL_MULTIPART_PARSER_PART_FILENAME_MAX_CHAR,
+                                             MINIMAL_MULTIPART_PARSER_PART_CONTENT_TYPE_MAX_CHAR};
+    if (header->state > MultipartParserHeaderState_EncodingValue || header->line_size > MINIMAL_MULTIPART_PARSER_HEADER_LINE_MAX_CHAR ||
+        header->field > FIELD_CONTENT_TYPE || header->field_size > field_max[header->field])
+    {
+        return false;
+    }
+
+    // Names are only matched in these states, the others set the candidates afresh before using them
+    const char *const *names = NULL;
+    unsigned int name_count = 0;
+    switch (header->state)
+    {
+        case MultipartParserHeaderState_Name:
+            names = header_names;
+            name_count = HEADER_COUNT;
+            break;
+        case MultipartParserHeaderState_ParamName:
+            names = param_names;
+            name_count = PARAM_COUNT;
+            break;
+        case MultipartParserHeaderState_EncodingValue:
+            names = encoding_names;
+            name_count = ENCODING_COUNT;
+            break;
+        default:
+            return true;
+    }
+    if (header->candidates >> name_count)
+    {
+        return false;
+    }
+    for (unsigned int i = 0; i < name_count; i++)
+    {
+        for (unsigned int j = 0; (header->candidates & (1u << i)) && j < header->name_size; j++)
+        {
+            if (names[i][j] == '\0')
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+size_t minimal_multipart_parser_checkpoint_save(const MinimalMultipartParserContext *context, const MinimalMultipartParserSink *sink, const unsigned long long stream_offset, unsigned char *blob,
+                                                const size_t blob_size)
+{
+    CheckpointWriter writer = {blob, blob_size, 0, 2166136261ul};
+#ifdef MINIMAL_MULTIPART_PARSER_COMPACT_CONTEXT
+    const unsigned int boundary_count = context->boundary ? context_delimiter_count(context) : 0;
+#else
+    const unsigned int boundary_count = context_delimiter_count(context);
+#endif
+    const MinimalMultipartParserPartInfo *part = context_part((MinimalMultipartParserContext *)context);
+
+    unsigned int flags = 0;
+    if (context_boundary_known(context))
+    {
+        flags |= CHECKPOINT_FLAG_BOUNDARY_COMPILED;
+    }
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_DIGEST
+    if (context->digest.enabled)
+    {
+        flags |= CHECKPOINT_FLAG_DIGEST;
+    }
+#endif
+    if (sink)
+    {
+        flags |= CHECKPOINT_FLAG_SINK;
+    }
+
+    for (unsigned int i = 0; i < 4; i++)
+    {
+        checkpoint_put(&writer, (unsigned char)CHECKPOINT_MAGIC[i], 1);
+    }
+    checkpoint_put(&writer, CHECKPOINT_VERSION, 1);
+    checkpoint_put(&writer, flags, 1);
+
+    checkpoint_put(&writer, context->phase, 1);
+    checkpoint_put(&writer, context->boundary_match, 1);
+    checkpoint_put(&writer, context->transfer_encoding, 1);
+    checkpoint_put(&writer, context->header.state, 1);
+    checkpoint_put(&writer, context->header.candidates, 1);
+    checkpoint_put(&writer, context->header.name_size, 1);
+    checkpoint_put(&writer, context->header.field, 1);
+    checkpoint_put(&writer, context->header.field_size, 1);
+    checkpoint_put(&writer, context->header.line_size, 2);
+    checkpoint_put(&writer, context->parts_completed, 4);
+    checkpoint_put(&writer, context->parts_skipped, 4);
+    checkpoint_put(&writer, context->section_size, 8);
+    checkpoint_put(&writer, stream_offset, 8);
+
+    // Boundary as found so far, which is only part of it while it is still being read from the first line
+    checkpoint_put(&writer, boundary_count, 1);
+    for (unsigned int i = 0; i < boundary_count; i++)
+    {
+        checkpoint_put(&writer, (unsigned char)context_delimiter(context)[i], 1);
+    }
+
+    checkpoint_put_string(&writer, part ? part->name : "", MINIMAL_MULTIPART_PARSER_PART_NAME_MAX_CHAR);
+    checkpoint_put_string(&writer, part ? part->filename : "", MINIMAL_MULTIPART_PARSER_PART_FILENAME_MAX_CHAR);
+    checkpoint_put_string(&writer, part ? part->content_type : "", MINIMAL_MULTIPART_PARSER_PART_CONTENT_TYPE_MAX_CHAR);
+
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_DIGEST
+    if (flags & CHECKPOINT_FLAG_DIGEST)
+    {
+        checkpoint_put(&writer, context->digest.crc32c, 4);
+        for (unsigned int i = 0; i < 8; i++)
+        {
+            checkpoint_put(&writer, context->digest.sha256_state[i], 4);
+        }
+        checkpoint_put(&writer, context->digest.sha256_size, 8);
+        for (unsigned int i = 0; i < 64; i++)
+        {
+            checkpoint_put(&writer, context->digest.sha256_block[i], 1);
+        }
+    }
+#endif
+
+    if (sink)
+    {
+        checkpoint_put(&writer, sink->decode_count, 1);
+        checkpoint_put(&writer, sink->decode_bits, 4);
+    }
+
+    checkpoint_put(&writer, writer.hash, 4);
+    return (writer.count <= blob_size) ? writer.count : 0;
+}
+
+bool minimal_multipart_parser_checkpoint_restore(MinimalMultipartParserContext *context, MinimalMultipartParserSink *sink, const unsigned char *blob, const size_t blob_size,
+                                                 unsigned long long *stream_offset)
+{
+    CheckpointReader reader = {blob, blob_size, 0, true, 2166136261ul};
+    for (unsigned int i = 0; i < 4; i++)
+    {
+        if (checkpoint_get(&reader, 1) != (unsigned char)CHECKPOINT_MAGIC[i])
+        {
+            return false;
+        }
+    }
+    if (checkpoint_get(&reader, 1) != CHECKPOINT_VERSION)
+    {
+        return false;
+    }
+    const unsigned int flags = (unsigned int)checkpoint_get(&reader, 1);
+
+    // Build the restored state on the side, so a bad blob leaves the context as it was
+    MinimalMultipartParserContext restored = *context;
+#ifndef MINIMAL_MULTIPART_PARSER_COMPACT_CONTEXT
+    buffer_reset(&(restored.data));
+#endif
+    restored.data_view = NULL;
+    restored.data_view_size = 0;
+    restored.data_available = false;
+
+    const unsigned int phase = (unsigned int)checkpoint_get(&reader, 1);
+    restored.phase = phase;
+    restored.boundary_match = (unsigned char)checkpoint_get(&reader, 1);
+    restored.transfer_encoding = (unsigned char)checkpoint_get(&reader, 1);
+    restored.header.state = (unsigned char)checkpoint_get(&reader, 1);
+    restored.header.candidates = (unsigned char)checkpoint_get(&reader, 1);
+    restored.header.name_size = (unsigned char)checkpoint_get(&reader, 1);
+    restored.header.field = (unsigned char)checkpoint_get(&reader, 1);
+    restored.header.field_size = (unsigned char)checkpoint_get(&reader, 1);
+    restored.header.line_size = (unsigned short)checkpoint_get(&reader, 2);
+    restored.parts_completed = (unsigned int)checkpoint_get(&reader, 4);
+    restored.parts_skipped = (unsigned int)checkpoint_get(&reader, 4);
+    restored.section_size = (size_t)checkpoint_get(&reader, 8);
+    const unsigned long long offset = checkpoint_get(&reader, 8);
+
+    const unsigned int boundary_count = (unsigned int)checkpoint_get(&reader, 1);
+    if (!reader.ok || phase > MultipartParserPhase_LimitExceeded || boundary_count > MINIMAL_MULTIPART_PARSER_MAX_CHAR || restored.boundary_match > boundary_count ||
+        !checkpoint_header_valid(&(restored.header)) || restored.transfer_encoding > MultipartParserTransferEncoding_QuotedPrintable)
+    {
+        return false;
+    }
+
+    // Past the boundary line the delimiter is searched for, which needs a whole `\r\n--BOUNDARY` marked as known (and its skip table
+    // built, where there is one, as an all zero table would never let the chunk api move on)
+    const bool compiled = (flags & CHECKPOINT_FLAG_BOUNDARY_COMPILED) != 0;
+    const bool searching = phase == MultipartParserPhase_Preamble_SeekBoundary || (phase >= MultipartParserPhase_SkipFileHeader && phase <= MultipartParserPhase_Epilogue);
+    if ((searching && !compiled) || (compiled && boundary_count < 5))
+    {
+        return false;
+    }
+
+#ifndef MINIMAL_MULTIPART_PARSER_BOUNDARY_DISCOVERY
+    // Boundary is not ours to write, so it has to be the one the blob was saved with
+    bool same = context_boundary_known(&restored) && (flags & CHECKPOINT_FLAG_BOUNDARY_COMPILED) && context_delimiter_count(&restored) == boundary_count;
+    for (unsigned int i = 0; i < boundary_count; i++)
+    {
+        const char c = (char)checkpoint_get(&reader, 1);
+        same = same && context_delimiter(&restored)[i] == c;
+    }
+#ifdef MINIMAL_MULTIPART_PARSER_FIXED_BOUNDARY
+    // A zeroed context is still in INIT until its first byte
+    const bool discovery_phase = phase > MultipartParserPhase_INIT && phase < MultipartParserPhase_SkipFileHeader && phase != MultipartParserPhase_Preamble_SeekBoundary;
+#else
+    const bool discovery_phase = phase < MultipartParserPhase_SkipFileHeader && phase != MultipartParserPhase_Preamble_SeekBoundary;
+#endif
+    if (!same || discovery_phase)
+    {
+        return false;
+    }
+#else
+    buffer_reset(&(restored.boundary.string));
+    for (unsigned int i = 0; i < boundary_count; i++)
+    {
+        buffer_add(&(restored.boundary.string), (char)checkpoint_get(&reader, 1));
+    }
+    restored.boundary.known = false;
+    if (flags & CHECKPOINT_FLAG_BOUNDARY_COMPILED)
+    {
+        boundary_compile(&(restored.boundary));
+    }
+#endif
+
+    MinimalMultipartParserPartInfo *part = context_part(&restored);
+    checkpoint_get_string(&reader, part ? part->name : NULL, MINIMAL_MULTIPART_PARSER_PART_NAME_MAX_CHAR);
+    checkpoint_get_string(&reader, part ? part->filename : NULL, MINIMAL_MULTIPART_PARSER_PART_FILENAME_MAX_CHAR);
+    checkpoint_get_string(&reader, part ? part->content_type : NULL, MINIMAL_MULTIPART_PARSER_PART_CONTENT_TYPE_MAX_CHAR);
+
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_DIGEST
+    restored.digest.enabled = (flags & CHECKPOINT_FLAG_DIGEST) != 0;
+#endif
+    if (flags & CHECKPOINT_FLAG_DIGEST)
+    {
+        // Kept even by builds without digests, which just skip over it
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_DIGEST
+        restored.digest.crc32c = (uint32_t)checkpoint_get(&reader, 4);
+        for (unsigned int i = 0; i < 8; i++)
+        {
+            restored.digest.sha256_state[i] = (uint32_t)checkpoint_get(&reader, 4);
+        }
+        restored.digest.sha256_size = checkpoint_get(&reader, 8);
+        for (unsigned int i = 0; i < 64; i++)
+        {
+            restored.digest.sha256_block[i] = (unsigned char)checkpoint_get(&reader, 1);
+        }
+#else
+        for (unsigned int i = 0; i < 4 + 8 * 4 + 8 + 64; i++)
+        {
+            checkpoint_get(&reader, 1);
+        }
+#endif
+    }
+
+    unsigned char decode_count = 0;
+    unsigned long decode_bits = 0;
+    if (flags & CHECKPOINT_FLAG_SINK)
+    {
+        decode_count = (unsigned char)checkpoint_get(&reader, 1);
+        decode_bits = (unsigned long)checkpoint_get(&reader, 4);
+        if (decode_count > 3)
+        {
+            // Base64 holds at most 3 sextets, and quoted-printable's escape states go up to QP_SOFT_BREAK
+            return false;
+        }
+    }
+
+    const unsigned long hash = reader.hash;
+    if (checkpoint_get(&reader, 4) != hash || !reader.ok || reader.count != blob_size)
+    {
+        return false;
+    }
+
+    *context = restored;
+    if (sink)
+    {
+        sink->buffer_count = 0;
+        sink->decode_count = decode_count;
+        sink->decode_bits = (unsigned int)decode_bits;
+    }
+    if (stream_offset)
+    {
+        *stream_offset = offset;
+    }
+    return true;
+}
+
+// Zero the context, keeping what the caller set up after init (limits, digest switch) and the stats that run across bodies
+static void context_clear(MinimalMultipartParserContext *context)
+{
+    const MinimalMultipartParserLimits *limits = context->limits;
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_DIGEST
+    const bool digest = context->digest.enabled;
+#endif
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_STATS
+    const MinimalMultipartParserStats stats = context->stats;
+#endif
+#ifdef MINIMAL_MULTIPART_PARSER_COMPACT_CONTEXT
+    MinimalMultipartParserPartInfo *part = context->part;
+    *context = (MinimalMultipartParserContext){0};
+    context->part = part;
+#else
+    *context = (MinimalMultipartParserContext){0};
+#endif
+    context->limits = limits;
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_DIGEST
+    context->digest.enabled = digest;
+#endif
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_STATS
+    context->stats = stats;
+#endif
+}
+
+void minimal_multipart_parser_reset(MinimalMultipartParserContext *context)
+{
+    if (!context_boundary_known(context))
+    {
+        // Boundary was not found yet, so there is nothing to keep
+        context_clear(context);
+        return;
+    }
+
+    // Keep the boundary and its skip table, only the state of the stream itself starts over
+#ifndef MINIMAL_MULTIPART_PARSER_COMPACT_CONTEXT
+    buffer_reset(&(context->data));
+#endif
+    context->data_view = NULL;
+    context->data_view_size = 0;
+    context->data_available = false;
+    context->parts_completed = 0;
+    context->parts_skipped = 0;
+    context->header = (MinimalMultipartParserHeaderParser){0};
+    part_begin(context);
+
+    // Same as after init, the next body may open with the first delimiter without a CRLF in front of it
+    context->boundary_match = 2;
+    context->phase = MultipartParserPhase_Preamble_SeekBoundary;
+}
+
+#ifdef MINIMAL_MULTIPART_PARSER_COMPACT_CONTEXT
+void minimal_multipart_parser_init_shared(MinimalMultipartParserContext *context, const MinimalMultipartParserBoundary *boundary, MinimalMultipartParserPartInfo *part)
+{
+    *context = (MinimalMultipartParserContext){0};
+    context->boundary = boundary;
+    context->part = part;
+
+    // The body may open with the first delimiter without a CRLF in front of it, so act as if we just got one
+    context->boundary_match = 2;
+    context->phase = MultipartParserPhase_Preamble_SeekBoundary;
+}
+
+#define POOL_NO_SLOT (~0u)
+
+void minimal_multipart_parser_pool_init(MinimalMultipartParserPool *pool, MinimalMultipartParserPoolSlot *slots, const unsigned int slot_count, MinimalMultipartParserPoolBoundary *boundaries,
+                                        const unsigned int boundary_count)
+{
+    pool->slots = slots;
+    pool->slot_count = slot_count;
+    pool->boundaries = boundaries;
+    pool->boundary_count = boundary_count;
+    pool->limits = NULL;
+
+    // Every slot starts out on the free list, in order
+    for (unsigned int i = 0; i < slot_count; i++)
+    {
+        slots[i].next_free = (i + 1 < slot_count) ? i + 1 : POOL_NO_SLOT;
+    }
+    pool->free_slot = (slot_count > 0) ? 0 : POOL_NO_SLOT;
+
+    for (unsigned int i = 0; i < boundary_count; i++)
+    {
+        boundaries[i].references = 0;
+    }
+}
+
+MinimalMultipartParserContext *minimal_multipart_parser_pool_acquire(MinimalMultipartParserPool *pool, const char *content_type, const size_t size, MinimalMultipartParserPartInfo *part)
+{
+    size_t start = 0;
+    size_t end = 0;
+    if (pool->free_slot == POOL_NO_SLOT || !content_type_boundary(content_type, size, &start, &end))
+    {
+        return NULL;
+    }
+
+    // Share the descriptor of an upload already in flight with the same boundary, or else take an unused one.
+    // A linear search, as the descriptors in use are expected to number in the thousands at most.
+    MinimalMultipartParserPoolBoundary *shared = NULL;
+    MinimalMultipartParserPoolBoundary *unused = NULL;
+    const unsigned int count = (unsigned int)(end - start) + 4;
+    for (unsigned int i = 0; i < pool->boundary_count && !shared; i++)
+    {
+        MinimalMultipartParserPoolBoundary *entry = &(pool->boundaries[i]);
+        if (entry->references == 0)
+        {
+            unused = unused ? unused : entry;
+        }
+        else if (entry->boundary.string.count == count)
+        {
+            bool same = true;
+            for (unsigned int j = 4; j < count && same; j++)
+            {
+                same = entry->boundary.string.buffer[j] == content_type[start + j - 4];
+            }
+            shared = same ? entry : NULL;
+        }
+    }
+
+    if (!shared)
+    {
+        if (!unused || !minimal_multipart_parser_boundary_init(&(unused->boundary), &content_type[start], end - start))
+        {
+            return NULL;
+        }
+        shared = unused;
+    }
+
+    MinimalMultipartParserPoolSlot *slot = &(pool->slots[pool->free_slot]);
+    pool->free_slot = slot->next_free;
+    shared->references++;
+    minimal_multipart_parser_init_shared(&(slot->context), &(shared->boundary), part);
+    slot->context.limits = pool->limits;
+    return &(slot->context);
+}
+
+void minimal_multipart_parser_pool_release(MinimalMultipartParserPool *pool, MinimalMultipartParserContext *context)
+{
+    // Descriptor is the first member of its pool entry, just as the context is of its slot
+    MinimalMultipartParserPoolBoundary *shared = (MinimalMultipartParserPoolBoundary *)context->boundary;
+    MinimalMultipartParserPoolSlot *slot = (MinimalMultipartParserPoolSlot *)context;
+    if (shared && shared->references > 0)
+    {
+        shared->references--;
+    }
+
+    context->boundary = NULL;
+    slot->next_free = pool->free_slot;
+    pool->free_slot = (unsigned int)(slot - pool->slots);
+}
+#elif !defined(MINIMAL_MULTIPART_PARSER_FIXED_BOUNDARY)
+bool minimal_multipart_parser_init_with_boundary(MinimalMultipartParserContext *context, const char *boundary, const size_t size)
+{
+    MinimalMultipartParserBoundary compiled;
+    if (!minimal_multipart_parser_boundary_init(&compiled, boundary, size))
+    {
+        return false;
+    }
+
+    *context = (MinimalMultipartParserContext){0};
+    context->boundary = compiled;
+
+    // The body may open with the first delimiter without a CRLF in front of it, so act as if we just got one
+    context->boundary_match = 2;
+    context->phase = MultipartParserPhase_Preamble_SeekBoundary;
+    return true;
+}
+
+bool minimal_multipart_parser_init_from_content_type(MinimalMultipartParserContext *context, const char *content_type, const size_t size)
+{
+    size_t start = 0;
+    size_t end = 0;
+    return content_type_boundary(content_type, size, &start, &end) && minimal_multipart_parser_init_with_boundary(context, &content_type[start], end - start);
+}
+
+bool minimal_multipart_parser_reset_from_content_type(MinimalMultipartParserContext *context, const char *content_type, const size_t size)
+{
+    size_t start = 0;
+    size_t end = 0;
+    if (!content_type_boundary(content_type, size, &start, &end))
+    {
+        return false;
+    }
+
+    // Same boundary as the last request, so it and its skip table can be kept
+    const MinimalMultipartParserCharBuffer *boundaryBuffer = &(context->boundary.string);
+    bool same = context->boundary.known && (buffer_count(boundaryBuffer) == end - start + 4);
+    for (size_t i = 0; same && i < end - start; i++)
+    {
+        same = boundaryBuffer->buffer[i + 4] == content_type[start + i];
+    }
+
+    if (same)
+    {
+        minimal_multipart_parser_reset(context);
+        return true;
+    }
+
+    // New boundary, so start over as init does, but like reset keep the limits, digest switch and stats
+    MinimalMultipartParserBoundary compiled;
+    if (!minimal_multipart_parser_boundary_init(&compiled, &content_type[start], end - start))
+    {
+        return false;
+    }
+    context_clear(context);
+    context->boundary = compiled;
+    context->boundary_match = 2;
+    context->phase = MultipartParserPhase_Preamble_SeekBoundary;
+    return true;
 }
+#endif
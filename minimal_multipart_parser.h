@@ -12,6 +12,10 @@
 
 #include "minimal_multipart_parser.h"
 #include <stdbool.h>
+#include <stddef.h>
+#if defined(MINIMAL_MULTIPART_PARSER_ENABLE_DIGEST) || defined(MINIMAL_MULTIPART_PARSER_ENABLE_STATS)
+#include <stdint.h>
+#endif
 
 // Size of the full boundary string we are searching for as a multipart file divider
 // e.g. `\r\n--BOUNDARY` where BOUNDARY is a user specified 70 bytes long printable ascii string
@@ -26,13 +30,44 @@
 
 #define MINIMAL_MULTIPART_PARSER_MAX_CHAR (MINIMAL_MULTIPART_PARSER_FULL_BOUNDARY_BUFFER_MAX_CHAR)
 
+// Part header values kept for each part. Longer values are truncated to fit.
+#ifndef MINIMAL_MULTIPART_PARSER_PART_NAME_MAX_CHAR
+#define MINIMAL_MULTIPART_PARSER_PART_NAME_MAX_CHAR (32)
+#endif
+#ifndef MINIMAL_MULTIPART_PARSER_PART_FILENAME_MAX_CHAR
+#define MINIMAL_MULTIPART_PARSER_PART_FILENAME_MAX_CHAR (64)
+#endif
+#ifndef MINIMAL_MULTIPART_PARSER_PART_CONTENT_TYPE_MAX_CHAR
+#define MINIMAL_MULTIPART_PARSER_PART_CONTENT_TYPE_MAX_CHAR (48)
+#endif
+
+// Define MINIMAL_MULTIPART_PARSER_COMPACT_CONTEXT (for both the library and your code) for servers holding very many contexts at once.
+// Each context then only points at a shared, read only boundary descriptor and optional part info storage, with no buffers of its own.
+// In this layout the boundary must be known up front and only the chunk and sink apis are available (not the per char api).
+
+// Define MINIMAL_MULTIPART_PARSER_FIXED_BOUNDARY as a string literal (for both the library and your code) when every body uses the same
+// boundary, known at build time, e.g. `-DMINIMAL_MULTIPART_PARSER_FIXED_BOUNDARY='"AaB03x"'` for a firmware updater that talks to one client.
+// The delimiter is then a constant in flash instead of a buffer and search table in each context, a zeroed context goes straight to
+// seeking the first delimiter without looking for a boundary line, and the calls that set a boundary at runtime are left out.
+// Only for the default layout, not the compact one.
+#if defined(MINIMAL_MULTIPART_PARSER_FIXED_BOUNDARY) && defined(MINIMAL_MULTIPART_PARSER_COMPACT_CONTEXT)
+#error "MINIMAL_MULTIPART_PARSER_FIXED_BOUNDARY is only for the default context layout"
+#endif
+
+// Budget for each part header line. Anything in a header line past this is skipped without being looked at.
+#ifndef MINIMAL_MULTIPART_PARSER_HEADER_LINE_MAX_CHAR
+#define MINIMAL_MULTIPART_PARSER_HEADER_LINE_MAX_CHAR (1024)
+#endif
+
 typedef enum MultipartParserEvent
 {
     MultipartParserEvent_None,
     MultipartParserEvent_FileStreamFound,
     MultipartParserEvent_FileStreamStarting,
     MultipartParserEvent_DataBufferAvailable,
-    MultipartParserEvent_DataStreamCompleted
+    MultipartParserEvent_DataStreamCompleted,
+    MultipartParserEvent_MultipartStreamCompleted,
+    MultipartParserEvent_LimitExceeded // See MinimalMultipartParserLimits, the rest of the body is ignored
 } MultipartParserEvent;
 
 typedef enum MultipartParserPhase
@@ -42,34 +77,398 @@ typedef enum MultipartParserPhase
     MultipartParserPhase_Preamble_CR,
     MultipartParserPhase_Preamble_LF,
     MultipartParserPhase_Preamble_HYPHEN,
+    MultipartParserPhase_Preamble_SeekBoundary,
     MultipartParserPhase_GetBoundary,
     MultipartParserPhase_GetBoundary_Done,
     MultipartParserPhase_SkipFileHeader,
     MultipartParserPhase_GetFileBytes,
-    MultipartParserPhase_EndOfFile
+    MultipartParserPhase_SkipFileBytes, // Body of a part passed over by minimal_multipart_parser_skip_part()
+    MultipartParserPhase_EndOfFile,
+    MultipartParserPhase_EndOfFile_CR,
+    MultipartParserPhase_EndOfFile_HYPHEN,
+    MultipartParserPhase_Epilogue,
+    MultipartParserPhase_LimitExceeded
 } MultipartParserPhase;
 
+// `Content-Transfer-Encoding` of a part
+typedef enum MultipartParserTransferEncoding
+{
+    MultipartParserTransferEncoding_Identity, // `7bit`, `8bit`, `binary` or no header at all
+    MultipartParserTransferEncoding_Base64,
+    MultipartParserTransferEncoding_QuotedPrintable
+} MultipartParserTransferEncoding;
+
+typedef enum MultipartParserHeaderState
+{
+    MultipartParserHeaderState_LineStart,
+    MultipartParserHeaderState_Name,
+    MultipartParserHeaderState_SkipLine,
+    MultipartParserHeaderState_CR,
+    MultipartParserHeaderState_End_CR,
+    MultipartParserHeaderState_ValueStart,
+    MultipartParserHeaderState_Value,
+    MultipartParserHeaderState_DispositionType,
+    MultipartParserHeaderState_ParamStart,
+    MultipartParserHeaderState_ParamName,
+    MultipartParserHeaderState_ParamValueStart,
+    MultipartParserHeaderState_ParamQuoted,
+    MultipartParserHeaderState_ParamQuotedEscape,
+    MultipartParserHeaderState_ParamToken,
+    MultipartParserHeaderState_ParamNext,
+    MultipartParserHeaderState_EncodingValue
+} MultipartParserHeaderState;
+
+typedef struct MinimalMultipartParserPartInfo
+{
+    char name[MINIMAL_MULTIPART_PARSER_PART_NAME_MAX_CHAR + 1];
+    char filename[MINIMAL_MULTIPART_PARSER_PART_FILENAME_MAX_CHAR + 1];
+    char content_type[MINIMAL_MULTIPART_PARSER_PART_CONTENT_TYPE_MAX_CHAR + 1];
+} MinimalMultipartParserPartInfo;
+
+typedef struct MinimalMultipartParserHeaderParser
+{
+    unsigned short line_size;   // Bytes seen so far in this header line
+    unsigned char state;        // MultipartParserHeaderState
+    unsigned char candidates;   // Bitmask of the header or parameter names still matching
+    unsigned char name_size;    // Header or parameter name bytes matched so far
+    unsigned char field;        // Which part info field the current value is copied into
+    unsigned char field_size;   // Bytes copied into that field so far
+} MinimalMultipartParserHeaderParser;
+
+// Optional caps on how much a client can make the parser go through, each 0 for no limit. The moment one is exceeded the parser
+// returns MultipartParserEvent_LimitExceeded and ignores the rest of the body, so a server can drop the connection right away.
+// Point a context's `limits` at one after init (many contexts can share it). minimal_multipart_parser_reset() keeps it.
+typedef struct MinimalMultipartParserLimits
+{
+    size_t preamble_bytes; // Before the first part's headers
+    size_t header_bytes;   // Header block of each part
+    size_t part_bytes;     // Body of each part
+    unsigned int parts;    // Parts in the whole body
+} MinimalMultipartParserLimits;
+
+// Parts to keep, for when only a few fields of a big form are wanted: a part is kept if its name is one of `names` or its
+// filename matches one of the `filenames` globs (`*` for any run of chars, `?` for any one char). See minimal_multipart_parser_skip_part().
+typedef struct MinimalMultipartParserFilter
+{
+    const char *const *names;
+    unsigned int name_count;
+    const char *const *filenames;
+    unsigned int filename_count;
+} MinimalMultipartParserFilter;
+
 typedef struct MinimalMultipartParserCharBuffer
 {
     char buffer[MINIMAL_MULTIPART_PARSER_MAX_CHAR + 1];
     unsigned int count;
 } MinimalMultipartParserCharBuffer;
 
+// Define MINIMAL_MULTIPART_PARSER_ENABLE_SKIP_TABLE (for both the library and your code) to keep a Horspool shift table with the
+// boundary, so the portable scanner of the chunk api skips ahead by close to the delimiter length instead of stopping at every `\r`.
+// This adds 256 bytes to each boundary, which the per char api never reads and the vector scanner does not need.
+// A fixed boundary build has no boundary to keep it in and always uses the plain `\r` candidate scan.
+typedef struct MinimalMultipartParserBoundary
+{
+    MinimalMultipartParserCharBuffer string; // Full delimiter e.g. `\r\n--BOUNDARY`
+    bool known;                              // Set once the whole delimiter is in `string` and ready to be searched for
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_SKIP_TABLE
+    unsigned char skip[256]; // Horspool shift for each byte value, computed once the boundary is known
+#endif
+} MinimalMultipartParserBoundary;
+
+// Define MINIMAL_MULTIPART_PARSER_ENABLE_DIGEST (for both the library and your code) to have the CRC32C and SHA-256 of each part's body
+// worked out as the parser hands it over, so files need not be read a second time for integrity checks or deduplication.
+// This adds about 150 bytes to each context, and is only done for contexts with `digest.enabled` set.
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_DIGEST
+typedef struct MinimalMultipartParserDigest
+{
+    bool enabled;                    // Set after init, kept by minimal_multipart_parser_reset()
+    uint32_t crc32c;                 // Running value, final once the part is complete
+    uint32_t sha256_state[8];        // Running hash state
+    uint64_t sha256_size;            // Body bytes of the current part so far
+    unsigned char sha256_block[64];  // Bytes not yet hashed, and the final SHA-256 once the part is complete
+} MinimalMultipartParserDigest;
+#endif
+
+// Define MINIMAL_MULTIPART_PARSER_ENABLE_STATS (for both the library and your code) to have each context count where its input went,
+// e.g. to tell a huge preamble from long part headers or file data full of boundary near misses when throughput drops.
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_STATS
+typedef struct MinimalMultipartParserStats
+{
+    uint64_t phase_bytes[MultipartParserPhase_LimitExceeded + 1]; // Input bytes taken in each MultipartParserPhase
+    uint64_t events[MultipartParserEvent_LimitExceeded + 1];      // Times each MultipartParserEvent fired (None is not counted)
+    uint64_t boundary_restarts;                                   // Possible delimiters in file data that had to be checked but were not one
+    uint64_t bytes_inspected;                                     // Input bytes read, counting a byte again each time the delimiter search reads it again
+    unsigned int header_size;                                     // Bytes in the current part's header block so far
+    unsigned int max_header_size;                                 // Longest part header block, from the `--BOUNDARY` line end to the blank line
+} MinimalMultipartParserStats;
+#endif
+
+#ifdef MINIMAL_MULTIPART_PARSER_COMPACT_CONTEXT
+typedef struct MinimalMultipartParserContext
+{
+    const MinimalMultipartParserBoundary *boundary; // Shared with every other context using the same boundary
+    MinimalMultipartParserPartInfo *part;           // Where to keep the current part's headers, or NULL to not keep them
+    const MinimalMultipartParserLimits *limits;     // Optional, NULL for none
+    size_t section_size;                            // Bytes of the preamble, current part header or current part body so far
+    const char *data_view;
+    unsigned int data_view_size;
+    unsigned int parts_completed;
+    unsigned int parts_skipped;
+    MinimalMultipartParserHeaderParser header;
+    unsigned char phase; // MultipartParserPhase
+    unsigned char boundary_match;
+    bool data_available;
+    unsigned char transfer_encoding;
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_DIGEST
+    MinimalMultipartParserDigest digest;
+#endif
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_STATS
+    MinimalMultipartParserStats stats;
+#endif
+} MinimalMultipartParserContext;
+#else
 typedef struct MinimalMultipartParserContext
 {
     MultipartParserPhase phase;
-    MinimalMultipartParserCharBuffer boundary;
+#ifndef MINIMAL_MULTIPART_PARSER_FIXED_BOUNDARY
+    MinimalMultipartParserBoundary boundary;
+#endif
+    unsigned char boundary_match; // How much of the delimiter the latest bytes matched
     MinimalMultipartParserCharBuffer data;
 
+    // Bytes released by the last MultipartParserEvent_DataBufferAvailable event.
+    // Points into `data` for bytes the parser had to hold back, or straight into the caller's input buffer
+    const char *data_view;
+    unsigned int data_view_size;
+
     bool data_available;
+
+    unsigned int parts_completed;
+    unsigned int parts_skipped; // Passed over by minimal_multipart_parser_skip_part(), they still count against the `parts` limit
+
+    // Headers of the current part, filled in by the time MultipartParserEvent_FileStreamStarting fires
+    MinimalMultipartParserHeaderParser header;
+    MinimalMultipartParserPartInfo part;
+    unsigned char transfer_encoding; // MultipartParserTransferEncoding
+
+    const MinimalMultipartParserLimits *limits; // Optional, NULL for none
+    size_t section_size;                        // Bytes of the preamble, current part header or current part body so far
+
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_DIGEST
+    MinimalMultipartParserDigest digest;
+#endif
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_STATS
+    MinimalMultipartParserStats stats;
+#endif
 } MinimalMultipartParserContext;
+#endif
+
+// Optional callback interface, driven by minimal_multipart_parser_process_sink(). Any callback may be NULL.
+typedef struct MinimalMultipartParserSink
+{
+    // Part headers are already parsed when on_part_begin is called
+    void (*on_part_begin)(void *user_data, const MinimalMultipartParserContext *context);
+    void (*on_data)(void *user_data, const char *data, const size_t size);
+    void (*on_part_end)(void *user_data, const MinimalMultipartParserContext *context);
+    void *user_data;
 
-static inline const unsigned int minimal_multipart_parser_get_data_size(const MinimalMultipartParserContext *context) { return context->data.count; }
+    // Optional scratch buffer of any size. File data is gathered in here and passed to on_data only once it is full or the part ends,
+    // e.g. to turn many small reads into 64 KiB writes. Without it, on_data gets every view as soon as the parser releases it.
+    char *buffer;
+    size_t buffer_size;
+    size_t buffer_count;
 
-static inline const char *minimal_multipart_parser_get_data_buffer(const MinimalMultipartParserContext *context) { return context->data.buffer; }
+    // Set to have parts sent with `Content-Transfer-Encoding: base64` or `quoted-printable` decoded on the way to on_data.
+    // Decoded bytes are written straight into `buffer` (or a small one on the stack if it is under 64 bytes).
+    bool decode;
+    unsigned char decode_count; // Base64 sextets or quoted-printable escape chars held in decode_bits
+    unsigned int decode_bits;
 
-static inline const bool minimal_multipart_parser_is_file_received(const MinimalMultipartParserContext *context) { return context->phase == MultipartParserPhase_EndOfFile; }
+    // Set to only get the parts it matches. Others are skipped without any callback, see minimal_multipart_parser_skip_part().
+    const MinimalMultipartParserFilter *filter;
+
+    // Set from a callback when whatever is downstream cannot take any more (e.g. a full socket or disk queue). process_sink() then
+    // returns once the event behind that callback is dealt with (a decoded view may still take a few on_data calls), and parsing
+    // resumes where it left off, partly matched delimiter included, when it is called again with the rest of the chunk.
+    bool paused;
+} MinimalMultipartParserSink;
+
+static inline const unsigned int minimal_multipart_parser_get_data_size(const MinimalMultipartParserContext *context) { return context->data_view_size; }
+
+static inline const char *minimal_multipart_parser_get_data_buffer(const MinimalMultipartParserContext *context) { return context->data_view; }
+
+static inline const bool minimal_multipart_parser_is_file_received(const MinimalMultipartParserContext *context) { return context->parts_completed > 0; }
+
+// `name` and `filename` parameters of the part's `Content-Disposition` header and its `Content-Type` media type.
+// Empty strings if the part did not send them. Valid from MultipartParserEvent_FileStreamStarting until the next part starts.
+#ifdef MINIMAL_MULTIPART_PARSER_COMPACT_CONTEXT
+static inline const char *minimal_multipart_parser_get_part_name(const MinimalMultipartParserContext *context) { return context->part ? context->part->name : ""; }
+
+static inline const char *minimal_multipart_parser_get_part_filename(const MinimalMultipartParserContext *context) { return context->part ? context->part->filename : ""; }
+
+static inline const char *minimal_multipart_parser_get_part_content_type(const MinimalMultipartParserContext *context) { return context->part ? context->part->content_type : ""; }
+#else
+static inline const char *minimal_multipart_parser_get_part_name(const MinimalMultipartParserContext *context) { return context->part.name; }
+
+static inline const char *minimal_multipart_parser_get_part_filename(const MinimalMultipartParserContext *context) { return context->part.filename; }
+
+static inline const char *minimal_multipart_parser_get_part_content_type(const MinimalMultipartParserContext *context) { return context->part.content_type; }
+#endif
+
+// Parsed from the part's `Content-Transfer-Encoding` header. The data events always carry the body as sent, see the sink for decoding.
+static inline const MultipartParserTransferEncoding minimal_multipart_parser_get_part_transfer_encoding(const MinimalMultipartParserContext *context)
+{
+    return (MultipartParserTransferEncoding)context->transfer_encoding;
+}
+
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_DIGEST
+// Digests of the body bytes as sent (before any transfer encoding is decoded). Valid from MultipartParserEvent_DataStreamCompleted
+// until the next part starts. The SHA-256 is 32 bytes, in the usual order for printing it as hex.
+static inline const uint32_t minimal_multipart_parser_get_part_crc32c(const MinimalMultipartParserContext *context) { return context->digest.crc32c; }
+
+static inline const unsigned char *minimal_multipart_parser_get_part_sha256(const MinimalMultipartParserContext *context) { return context->digest.sha256_block; }
+
+static inline const uint64_t minimal_multipart_parser_get_part_size(const MinimalMultipartParserContext *context) { return context->digest.sha256_size; }
+#endif
+
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_STATS
+// Counters since the context was initialised. They carry on across minimal_multipart_parser_reset(), so cover every body on a connection.
+static inline const MinimalMultipartParserStats *minimal_multipart_parser_get_stats(const MinimalMultipartParserContext *context) { return &(context->stats); }
+#endif
+
+static inline const unsigned int minimal_multipart_parser_get_parts_completed(const MinimalMultipartParserContext *context) { return context->parts_completed; }
+
+static inline const bool minimal_multipart_parser_is_multipart_completed(const MinimalMultipartParserContext *context) { return context->phase == MultipartParserPhase_Epilogue; }
+
+static inline const bool minimal_multipart_parser_is_limit_exceeded(const MinimalMultipartParserContext *context) { return context->phase == MultipartParserPhase_LimitExceeded; }
+
+// Boundary in use (without the leading `--`), or an empty string if it has not been found yet
+#ifdef MINIMAL_MULTIPART_PARSER_COMPACT_CONTEXT
+static inline const char *minimal_multipart_parser_get_boundary(const MinimalMultipartParserContext *context) { return context->boundary ? &(context->boundary->string.buffer[4]) : ""; }
+#elif defined(MINIMAL_MULTIPART_PARSER_FIXED_BOUNDARY)
+static inline const char *minimal_multipart_parser_get_boundary(const MinimalMultipartParserContext *context) { return MINIMAL_MULTIPART_PARSER_FIXED_BOUNDARY; }
+#else
+static inline const char *minimal_multipart_parser_get_boundary(const MinimalMultipartParserContext *context) { return context->boundary.string.count > 4 ? &(context->boundary.string.buffer[4]) : ""; }
+#endif
+
+// Fill in a boundary descriptor from just the boundary (e.g. `AaB03x`, without the leading `--`), or from the value of an HTTP
+// `Content-Type` header (e.g. `multipart/form-data; boundary=AaB03x`). Returns false if there is no valid boundary.
+bool minimal_multipart_parser_boundary_init(MinimalMultipartParserBoundary *boundary, const char *boundary_string, const size_t size);
+bool minimal_multipart_parser_boundary_from_content_type(MinimalMultipartParserBoundary *boundary, const char *content_type, const size_t size);
+
+// Get the context ready for the next body, e.g. the next request on a keep-alive connection, without going back to a zeroed context.
+// A boundary that was already known (given up front or found in the last body) is kept along with its search table, so the next body
+// must use the same boundary and its preamble is skipped like after minimal_multipart_parser_init_with_boundary(). Otherwise the
+// context is zeroed. In the compact layout the shared descriptor and part info storage stay attached.
+void minimal_multipart_parser_reset(MinimalMultipartParserContext *context);
+
+#ifdef MINIMAL_MULTIPART_PARSER_COMPACT_CONTEXT
+// Start a compact context on a boundary descriptor, which must stay unchanged for as long as any context uses it.
+// `part` is optional storage for the part headers, or NULL if you do not need the part name, filename and content type.
+void minimal_multipart_parser_init_shared(MinimalMultipartParserContext *context, const MinimalMultipartParserBoundary *boundary, MinimalMultipartParserPartInfo *part);
+
+// Fixed size pool of compact contexts for servers, so acquiring a context on each new upload never calls malloc.
+// Contexts uploading with the same boundary share one descriptor, and a descriptor is freed once no context uses it.
+// All storage comes from the caller, e.g. static arrays sized for the most uploads expected at once.
+typedef struct MinimalMultipartParserPoolSlot
+{
+    MinimalMultipartParserContext context; // First, so a context handed out is also a pointer to its slot
+    unsigned int next_free;
+} MinimalMultipartParserPoolSlot;
+
+typedef struct MinimalMultipartParserPoolBoundary
+{
+    MinimalMultipartParserBoundary boundary;
+    unsigned int references; // Contexts using this descriptor, it is free to reuse at zero
+} MinimalMultipartParserPoolBoundary;
+
+typedef struct MinimalMultipartParserPool
+{
+    MinimalMultipartParserPoolSlot *slots;
+    unsigned int slot_count;
+    unsigned int free_slot; // Head of the list of unused slots
+    MinimalMultipartParserPoolBoundary *boundaries;
+    unsigned int boundary_count;
+    const MinimalMultipartParserLimits *limits; // Optional, given to every context handed out. Set after minimal_multipart_parser_pool_init()
+} MinimalMultipartParserPool;
+
+void minimal_multipart_parser_pool_init(MinimalMultipartParserPool *pool, MinimalMultipartParserPoolSlot *slots, const unsigned int slot_count, MinimalMultipartParserPoolBoundary *boundaries,
+                                        const unsigned int boundary_count);
+
+// Hands out a context ready to parse a body with the boundary from this `Content-Type` header value.
+// Returns NULL if the header has no valid boundary, or if the pool is out of contexts or descriptors.
+MinimalMultipartParserContext *minimal_multipart_parser_pool_acquire(MinimalMultipartParserPool *pool, const char *content_type, const size_t size, MinimalMultipartParserPartInfo *part);
+
+// Give a context from minimal_multipart_parser_pool_acquire() back to the pool once its upload is done or dropped
+void minimal_multipart_parser_pool_release(MinimalMultipartParserPool *pool, MinimalMultipartParserContext *context);
+#else
+#ifndef MINIMAL_MULTIPART_PARSER_FIXED_BOUNDARY
+// Optional. Zero initialising the context makes the parser find the boundary on its own, by taking the first line of the form
+// `--BOUNDARY` as the boundary. If the HTTP `Content-Type` header is at hand, pass its value here instead (e.g.
+// `multipart/form-data; boundary=AaB03x`) so the boundary is known up front and the preamble is skipped without being parsed.
+// Returns false, leaving the context untouched, if no valid boundary was found.
+bool minimal_multipart_parser_init_from_content_type(MinimalMultipartParserContext *context, const char *content_type, const size_t size);
+
+// Same as above, but with just the boundary (e.g. `AaB03x`, without the leading `--`)
+bool minimal_multipart_parser_init_with_boundary(MinimalMultipartParserContext *context, const char *boundary, const size_t size);
+
+// For the next request on a connection: minimal_multipart_parser_reset() if this `Content-Type` names the boundary already in use,
+// otherwise the same as minimal_multipart_parser_init_from_content_type() but keeping the limits, digest switch and stats as reset does.
+// Returns false, leaving the context untouched, if there is no valid boundary.
+bool minimal_multipart_parser_reset_from_content_type(MinimalMultipartParserContext *context, const char *content_type, const size_t size);
+#endif
 
 MultipartParserEvent minimal_multipart_parser_process(MinimalMultipartParserContext *context, const char c);
+#endif
+
+// Process a whole chunk of the stream in one call.
+// Returns as soon as an event fires, with `consumed` set to the number of bytes used from `buffer` so far
+// (the byte that triggered the event included). Call again with the remaining bytes to continue.
+// `consumed` can be zero when bytes held back from an earlier chunk are handed over.
+// Output is byte for byte identical to feeding the same bytes through minimal_multipart_parser_process().
+// Runs of file bytes that cannot be part of a boundary are not copied, instead the data buffer points straight
+// into `buffer`, so it is only valid until the next call or until `buffer` is reused.
+MultipartParserEvent minimal_multipart_parser_process_buffer(MinimalMultipartParserContext *context, const char *buffer, const size_t size, size_t *consumed);
+
+// Process a whole chunk of the stream, passing every part to the sink callbacks instead of returning events.
+// Returns the number of bytes consumed, which is always `size` unless a callback paused the sink (see `paused`, cleared on each call)
+// or a limit was exceeded in this chunk. In the latter case it stops there without calling on_part_end (data still in the sink
+// buffer is dropped), see minimal_multipart_parser_is_limit_exceeded().
+size_t minimal_multipart_parser_process_sink(MinimalMultipartParserContext *context, MinimalMultipartParserSink *sink, const char *buffer, const size_t size);
+
+// Stateless search for the next whole `\r\n--BOUNDARY` delimiter in `buffer`, using the boundary already known to `context`
+// and the same scanner as the parser. Returns its offset, or `size` if there is none. Does not change the context, so many
+// threads may search disjoint ranges of one big input at once, e.g. to find where every part starts before parsing any of them.
+size_t minimal_multipart_parser_find_delimiter(const MinimalMultipartParserContext *context, const char *buffer, const size_t size);
+
+// True if the part whose headers were just parsed is one `filter` keeps. Call it on MultipartParserEvent_FileStreamStarting.
+bool minimal_multipart_parser_filter_match(const MinimalMultipartParserFilter *filter, const MinimalMultipartParserContext *context);
+
+// Call on MultipartParserEvent_FileStreamStarting to pass over that part's body. It is searched for the next delimiter with the
+// same scanner as the preamble, so unwanted attachments cost little more than a memchr(), and no data events nor
+// MultipartParserEvent_DataStreamCompleted are returned for it (it does not count in minimal_multipart_parser_get_parts_completed()).
+// It still counts against the `parts` limit, and its body against the `part_bytes` limit.
+void minimal_multipart_parser_skip_part(MinimalMultipartParserContext *context);
+
+// Checkpoints, so parsing an interrupted upload can carry on from where it stopped (on another worker or after a restart) instead of from byte 0.
+// The blob is a versioned, portable byte string (no pointers, fixed byte order) of at most MINIMAL_MULTIPART_PARSER_CHECKPOINT_MAX_SIZE bytes, holding
+// the parse state including a partly matched delimiter, the current part headers and `stream_offset`, the offset of the next byte to parse.
+// Take it between calls, once the last event has been dealt with. For the sink api also pass the sink after calling
+// minimal_multipart_parser_sink_flush(), so a half decoded base64 or quoted-printable group is kept too (NULL otherwise).
+// Save returns the blob size, or 0 if `blob_size` is too small.
+#define MINIMAL_MULTIPART_PARSER_CHECKPOINT_MAX_SIZE (512)
+size_t minimal_multipart_parser_checkpoint_save(const MinimalMultipartParserContext *context, const MinimalMultipartParserSink *sink, const unsigned long long stream_offset, unsigned char *blob,
+                                                const size_t blob_size);
+
+// Restore into a context set up as for a new body: zeroed or initialised, with its `limits` set as before, and in the compact layout
+// already attached to the same boundary (init_shared() or the pool). Parsing then carries on from `*stream_offset`.
+// Returns false, leaving the context and sink untouched, if the blob is damaged, from an unknown version, for a different boundary, or
+// holds any value the parser could not have saved (so a forged blob cannot point the parser past its tables).
+bool minimal_multipart_parser_checkpoint_restore(MinimalMultipartParserContext *context, MinimalMultipartParserSink *sink, const unsigned char *blob, const size_t blob_size,
+                                                 unsigned long long *stream_offset);
+
+// Pass any data still gathered in the sink buffer to on_data. Done for you when a part ends,
+// but useful if the stream was cut short mid part.
+void minimal_multipart_parser_sink_flush(MinimalMultipartParserSink *sink);
 
 #endif
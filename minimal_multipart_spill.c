@@ -0,0 +1,261 @@
+//
+// minimal_multipart_spill.c
+//
+// Copyright (c) 2024 Brian Khuu https://briankhuu.com/
+// MIT licensed
+//
+// https://github.com/mofosyne/minimal-multipart-form-data-parser-c
+//
+
+#define _GNU_SOURCE
+
+#include "minimal_multipart_spill.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// Views at least this large are written straight from the parser's view instead of being staged
+#define SPILL_STAGE_MAX_VIEW (16 * 1024)
+
+static void spill_fail(MinimalMultipartSpill *spill, const int error)
+{
+    if (spill->error == 0)
+    {
+        spill->error = error;
+    }
+    spill->sink.paused = true;
+}
+
+static char *arena_alloc(MinimalMultipartSpill *spill, const size_t size)
+{
+    if (spill->arena_size - spill->arena_used < size)
+    {
+        return NULL;
+    }
+    char *block = &spill->arena[spill->arena_used];
+    spill->arena_used += size;
+    return block;
+}
+
+static const char *arena_string(MinimalMultipartSpill *spill, const char *string)
+{
+    const size_t size = strlen(string) + 1;
+    char *copy = arena_alloc(spill, size);
+    if (copy)
+    {
+        memcpy(copy, string, size);
+    }
+    return copy;
+}
+
+static int temp_file(const char *dir)
+{
+#ifdef O_TMPFILE
+    // Never has a name, so nothing is left behind if the process dies
+    const int unnamed = open(dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (unnamed >= 0 || (errno != EOPNOTSUPP && errno != EISDIR && errno != EINVAL))
+    {
+        return unnamed;
+    }
+#endif
+    char path[4096];
+    if (snprintf(path, sizeof(path), "%s/minimal_multipart_XXXXXX", dir) >= (int)sizeof(path))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    const int fd = mkstemp(path);
+    if (fd >= 0)
+    {
+        unlink(path);
+    }
+    return fd;
+}
+
+static bool write_vector(MinimalMultipartSpill *spill, const int fd, struct iovec *iov, unsigned int iov_count)
+{
+    while (iov_count > 0)
+    {
+        const ssize_t written = writev(fd, iov, (int)iov_count);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            spill_fail(spill, errno);
+            return false;
+        }
+
+        // Skip what got written, which may end partway through a vector
+        size_t left = (size_t)written;
+        while (iov_count > 0 && left >= iov->iov_len)
+        {
+            left -= iov->iov_len;
+            iov++;
+            iov_count--;
+        }
+        if (iov_count > 0)
+        {
+            iov->iov_base = (char *)iov->iov_base + left;
+            iov->iov_len -= left;
+        }
+    }
+    return true;
+}
+
+// Staging area is the free end of the arena, right after the current part's strings
+static char *stage(MinimalMultipartSpill *spill) { return &spill->arena[spill->arena_used]; }
+
+static bool stage_flush(MinimalMultipartSpill *spill, MinimalMultipartSpillPart *part, const char *data, const size_t size)
+{
+    struct iovec iov[2] = {{stage(spill), spill->staged}, {(void *)data, size}};
+    const bool written = write_vector(spill, part->fd, spill->staged > 0 ? &iov[0] : &iov[1], (spill->staged > 0 ? 1u : 0u) + (size > 0 ? 1u : 0u));
+    spill->staged = 0;
+    return written;
+}
+
+// Move the part so far out of the arena into a temp file, along with the view that did not fit
+static void spill_part(MinimalMultipartSpill *spill, MinimalMultipartSpillPart *part, const char *data, const size_t size)
+{
+    part->fd = temp_file(spill->spill_dir);
+    if (part->fd < 0)
+    {
+        spill_fail(spill, errno);
+        return;
+    }
+
+    const size_t held = part->size;
+    struct iovec iov[2] = {{(void *)part->data, held}, {(void *)data, size}};
+    spill->arena_used = (size_t)(part->data - spill->arena);
+    part->data = NULL;
+    spill->staged = 0;
+    write_vector(spill, part->fd, held > 0 ? &iov[0] : &iov[1], (held > 0 ? 1u : 0u) + (size > 0 ? 1u : 0u));
+}
+
+static void on_part_begin(void *user_data, const MinimalMultipartParserContext *context)
+{
+    MinimalMultipartSpill *spill = user_data;
+    if (spill->error != 0)
+    {
+        return;
+    }
+    if (spill->part_count == spill->part_capacity)
+    {
+        spill_fail(spill, ENOBUFS);
+        return;
+    }
+
+    MinimalMultipartSpillPart *part = &spill->parts[spill->part_count];
+    part->name = arena_string(spill, minimal_multipart_parser_get_part_name(context));
+    part->filename = arena_string(spill, minimal_multipart_parser_get_part_filename(context));
+    part->content_type = arena_string(spill, minimal_multipart_parser_get_part_content_type(context));
+    part->size = 0;
+    part->data = &spill->arena[spill->arena_used];
+    part->fd = -1;
+    part->complete = false;
+    if (!part->name || !part->filename || !part->content_type)
+    {
+        spill_fail(spill, ENOMEM);
+        return;
+    }
+    spill->part_count++;
+}
+
+static void on_data(void *user_data, const char *data, const size_t size)
+{
+    MinimalMultipartSpill *spill = user_data;
+    if (spill->error != 0 || spill->part_count == 0)
+    {
+        return;
+    }
+
+    MinimalMultipartSpillPart *part = &spill->parts[spill->part_count - 1];
+    if (part->fd < 0)
+    {
+        if (part->size + size <= spill->spill_threshold && arena_alloc(spill, size))
+        {
+            // Still small, so it stays in the arena right after what it already has
+            memcpy((char *)&part->data[part->size], data, size);
+            part->size += size;
+            return;
+        }
+        spill_part(spill, part, data, size);
+        part->size += size;
+        return;
+    }
+
+    // Small views are gathered in the arena's free end, and go out with the next one that does not fit in a single writev()
+    part->size += size;
+    const size_t stage_size = spill->arena_size - spill->arena_used;
+    if (size < SPILL_STAGE_MAX_VIEW && spill->staged + size <= stage_size)
+    {
+        memcpy(&stage(spill)[spill->staged], data, size);
+        spill->staged += size;
+        return;
+    }
+    stage_flush(spill, part, data, size);
+}
+
+static void on_part_end(void *user_data, const MinimalMultipartParserContext *context)
+{
+    MinimalMultipartSpill *spill = user_data;
+    if (spill->error != 0 || spill->part_count == 0)
+    {
+        return;
+    }
+
+    MinimalMultipartSpillPart *part = &spill->parts[spill->part_count - 1];
+    minimal_multipart_spill_finish(spill);
+    part->complete = (spill->error == 0);
+}
+
+void minimal_multipart_spill_init(MinimalMultipartSpill *spill, char *arena, const size_t arena_size, MinimalMultipartSpillPart *parts, const unsigned int part_capacity,
+                                  const size_t spill_threshold, const char *spill_dir)
+{
+    memset(spill, 0, sizeof(*spill));
+    spill->sink.on_part_begin = on_part_begin;
+    spill->sink.on_data = on_data;
+    spill->sink.on_part_end = on_part_end;
+    spill->sink.user_data = spill;
+    spill->arena = arena;
+    spill->arena_size = arena_size;
+    spill->parts = parts;
+    spill->part_capacity = part_capacity;
+    spill->spill_threshold = spill_threshold;
+    spill->spill_dir = spill_dir;
+}
+
+void minimal_multipart_spill_reset(MinimalMultipartSpill *spill)
+{
+    for (unsigned int i = 0; i < spill->part_count; i++)
+    {
+        if (spill->parts[i].fd >= 0)
+        {
+            close(spill->parts[i].fd);
+            spill->parts[i].fd = -1;
+        }
+    }
+    spill->part_count = 0;
+    spill->arena_used = 0;
+    spill->staged = 0;
+    spill->error = 0;
+    spill->sink.paused = false;
+}
+
+void minimal_multipart_spill_finish(MinimalMultipartSpill *spill)
+{
+    if (spill->part_count == 0)
+    {
+        return;
+    }
+    MinimalMultipartSpillPart *part = &spill->parts[spill->part_count - 1];
+    if (part->fd >= 0 && spill->staged > 0)
+    {
+        stage_flush(spill, part, NULL, 0);
+    }
+}
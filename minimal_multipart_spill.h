@@ -0,0 +1,68 @@
+//
+// minimal_multipart_spill.h
+//
+// Copyright (c) 2024 Brian Khuu https://briankhuu.com/
+// MIT licensed
+//
+// https://github.com/mofosyne/minimal-multipart-form-data-parser-c
+//
+
+// Optional companion module for POSIX systems: stores every part of a request so services need not each write their own
+// "small fields in memory, big files on disk". Parts are kept in a caller supplied arena, which is reset once per request instead of
+// freeing anything per part. A part that grows past `spill_threshold`, or no longer fits in the arena, is moved to an unnamed temp file
+// (O_TMPFILE where available) and the rest of it is written with large vectored writes, so memory per request never exceeds the arena.
+
+#ifndef MINIMAL_MULTIPART_SPILL_H
+#define MINIMAL_MULTIPART_SPILL_H
+
+#include "minimal_multipart_parser.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct MinimalMultipartSpillPart
+{
+    // Copied into the arena from the part headers
+    const char *name;
+    const char *filename;
+    const char *content_type;
+
+    size_t size;
+    const char *data; // In the arena, or NULL once spilled
+    int fd;           // Unnamed temp file holding the body from offset 0 once spilled, -1 otherwise
+    bool complete;    // False if the body was cut short
+} MinimalMultipartSpillPart;
+
+typedef struct MinimalMultipartSpill
+{
+    // Hand `&spill.sink` to minimal_multipart_parser_process_sink()
+    MinimalMultipartParserSink sink;
+
+    char *arena;
+    size_t arena_size;
+    size_t arena_used;
+
+    MinimalMultipartSpillPart *parts;
+    unsigned int part_capacity;
+    unsigned int part_count;
+
+    size_t spill_threshold; // Bodies larger than this go to a temp file
+    const char *spill_dir;  // Where temp files are made, e.g. "/tmp"
+
+    // Once the current part is spilled, the free end of the arena stages small views so they go out together with the next view
+    size_t staged;
+
+    int error; // errno of the first failure, 0 if none. The sink pauses when it is set, and stores nothing more this request
+} MinimalMultipartSpill;
+
+// Arena and part list are supplied by the caller and used for every request. The spill sink gathers nothing itself, so any
+// scratch buffer set on `spill->sink` afterwards only adds a copy.
+void minimal_multipart_spill_init(MinimalMultipartSpill *spill, char *arena, const size_t arena_size, MinimalMultipartSpillPart *parts, const unsigned int part_capacity,
+                                  const size_t spill_threshold, const char *spill_dir);
+
+// Close the temp files of the last request and take the whole arena back, ready for the next request
+void minimal_multipart_spill_reset(MinimalMultipartSpill *spill);
+
+// Finish off a part cut short when the request ended early. Its `complete` stays false.
+void minimal_multipart_spill_finish(MinimalMultipartSpill *spill);
+
+#endif
@@ -1,43 +1,715 @@
 //
-// test.c
+// multipart_extract.c
 //
 // Copyright (c) 2024 Brian Khuu
 // MIT licensed
 //
 
-// This is explicitly written to be very minimal and to use lots of
-// global static variables to allow for gauging the embedded
-// memory size requirement of this library
+// Extracts the first file of a multipart/form-data stream, from standard input or a file, to standard output.
+// Unlike multipart_extract_minimal.c this is written for throughput: input is read in large blocks (or mapped into memory
+// when it is a regular file) and output goes out in large write(2) calls, or straight from file to output with
+// copy_file_range(2)/splice(2) where the platform has them.
+//
+// Given `-j JOBS -o DIR` and a regular file, it instead extracts every part to its own file in DIR using JOBS threads:
+// one pass over byte ranges of the mapped input finds where every part starts, then a pool of workers parses the parts.
+//
+// With `--digest` the CRC32C and SHA-256 of each extracted part are printed as well, worked out by the parser as the bytes
+// go through (needs the library and this file built with MINIMAL_MULTIPART_PARSER_ENABLE_DIGEST, as the makefile does).
+// With `--stats` the parser's counters are printed to standard error at the end (MINIMAL_MULTIPART_PARSER_ENABLE_STATS).
+// With `--part NAME` (any number of times) only parts with that field name, or a filename matching NAME as a glob, are extracted;
+// the bodies of the others are skipped over without being copied anywhere.
+
+#define _GNU_SOURCE
 
 #include "minimal_multipart_parser.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define READ_BLOCK_SIZE (256 * 1024)
+#define WRITE_BLOCK_SIZE (64 * 1024)
+
+// Views into a mapped input at least this large are copied kernel side instead of through write(2)
+#define KERNEL_COPY_MIN_SIZE (64 * 1024)
+
+// Mapped input is fed in windows so we can stop soon after the first file instead of parsing the rest
+#define MAP_WINDOW_SIZE (4 * 1024 * 1024)
+
+// Inputs smaller than this per job are not worth starting a thread to search
+#define LOCATE_MIN_RANGE_SIZE (1024 * 1024)
+
+#if defined(__linux__) && defined(__GLIBC__) && ((__GLIBC__ > 2) || (__GLIBC_MINOR__ >= 27))
+#define HAVE_KERNEL_COPY
+#endif
+
+typedef struct Part
+{
+    size_t start; // Offset of the delimiter in front of the part
+    size_t end;   // Offset just past the delimiter after the part, or the end of the input
+    char *path;   // Output file, once the part headers have been seen
+    bool complete;
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_DIGEST
+    uint32_t crc32c;
+    unsigned char sha256[32];
+#endif
+} Part;
+
+typedef struct Extract
+{
+    int input_fd;
+    int output_fd;
+    const char *map;
+    size_t map_size;
+    bool done;
+    bool failed;
+
+    // Parallel mode only
+    const char *output_dir;
+    size_t part_index;
+    Part *part;
+
+    bool digest;
+} Extract;
+
+typedef struct Parallel
+{
+    const MinimalMultipartParserContext *discovery; // Context that found the boundary, only read by the threads
+    int input_fd;
+    const char *map;
+    size_t map_size;
+    const char *output_dir;
+    bool digest;
+    const MinimalMultipartParserFilter *filter; // NULL for every part
+
+    Part *parts;
+    size_t part_count;
+    size_t next_part;
+    pthread_mutex_t lock;
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_STATS
+    MinimalMultipartParserStats stats; // Every worker's counters added up, under `lock`
+#endif
+} Parallel;
+
+typedef struct Locate
+{
+    const Parallel *parallel;
+    size_t begin; // Delimiters starting in [begin, end) belong to this range
+    size_t end;
+    size_t *offsets;
+    size_t offset_count;
+    bool failed;
+} Locate;
 
 static MinimalMultipartParserContext state = {0};
+static char write_buffer[WRITE_BLOCK_SIZE];
+static char read_buffer[READ_BLOCK_SIZE];
 
-int main(void)
+static bool write_all(int fd, const char *data, size_t size)
 {
-    int c;
-    while ((c = getc(stdin)) != EOF)
+    while (size > 0)
     {
-        // Processor handles incoming stream character by character
-        const MultipartParserEvent event = minimal_multipart_parser_process(&state, (char)c);
+        const ssize_t written = write(fd, data, size);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= (size_t)written;
+    }
+    return true;
+}
+
+#ifdef HAVE_KERNEL_COPY
+// Copy a range of the input file to the output without it passing through user space.
+// Returns how many bytes were copied, which may fall short (even zero) if the output does not support it.
+static size_t kernel_copy(int input_fd, off_t offset, int output_fd, size_t size)
+{
+    size_t copied = 0;
+
+    // Works when the output is a regular file
+    while (copied < size)
+    {
+        const ssize_t result = copy_file_range(input_fd, &offset, output_fd, NULL, size - copied, 0);
+        if (result <= 0)
+        {
+            break;
+        }
+        copied += (size_t)result;
+    }
 
-        // Special Events That Needs Handling
-        if (event == MultipartParserEvent_DataBufferAvailable)
+    // Works when the output is a pipe
+    while (copied < size)
+    {
+        const ssize_t result = splice(input_fd, &offset, output_fd, NULL, size - copied, 0);
+        if (result <= 0)
         {
-            // Data Avaliable To Receive
-            for (unsigned int j = 0; j < minimal_multipart_parser_get_data_size(&state); j++)
+            break;
+        }
+        copied += (size_t)result;
+    }
+
+    return copied;
+}
+#endif
+
+static void on_data(void *user_data, const char *data, const size_t size)
+{
+    Extract *extract = user_data;
+    if (extract->done || extract->failed)
+    {
+        // Only the first file is extracted
+        return;
+    }
+
+    size_t copied = 0;
+#ifdef HAVE_KERNEL_COPY
+    if (extract->map && size >= KERNEL_COPY_MIN_SIZE && data >= extract->map && data + size <= extract->map + extract->map_size)
+    {
+        copied = kernel_copy(extract->input_fd, (off_t)(data - extract->map), extract->output_fd, size);
+    }
+#endif
+
+    if (!write_all(extract->output_fd, data + copied, size - copied))
+    {
+        extract->failed = true;
+    }
+}
+
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_DIGEST
+// `crc32c:XXXXXXXX sha256:XXXX...` for the part that just completed
+static void digest_print(FILE *output, const uint32_t crc32c, const unsigned char *sha256)
+{
+    fprintf(output, "crc32c:%08x sha256:", (unsigned int)crc32c);
+    for (unsigned int i = 0; i < 32; i++)
+    {
+        fprintf(output, "%02x", sha256[i]);
+    }
+}
+#endif
+
+static void on_part_end(void *user_data, const MinimalMultipartParserContext *context)
+{
+    Extract *extract = user_data;
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_DIGEST
+    if (extract->digest)
+    {
+        // File itself goes to standard output
+        digest_print(stderr, minimal_multipart_parser_get_part_crc32c(context), minimal_multipart_parser_get_part_sha256(context));
+        fprintf(stderr, "\n");
+    }
+#endif
+    extract->done = true;
+}
+
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_STATS
+static void stats_add(MinimalMultipartParserStats *total, const MinimalMultipartParserStats *stats)
+{
+    for (unsigned int i = 0; i <= MultipartParserPhase_LimitExceeded; i++)
+    {
+        total->phase_bytes[i] += stats->phase_bytes[i];
+    }
+    for (unsigned int i = 0; i <= MultipartParserEvent_LimitExceeded; i++)
+    {
+        total->events[i] += stats->events[i];
+    }
+    total->boundary_restarts += stats->boundary_restarts;
+    total->bytes_inspected += stats->bytes_inspected;
+    total->max_header_size = stats->max_header_size > total->max_header_size ? stats->max_header_size : total->max_header_size;
+}
+
+static void stats_print(const MinimalMultipartParserStats *stats)
+{
+    // Phases grouped by what part of the body they cover
+    unsigned long long preamble = 0;
+    for (unsigned int i = MultipartParserPhase_INIT; i <= MultipartParserPhase_GetBoundary_Done; i++)
+    {
+        preamble += stats->phase_bytes[i];
+    }
+    unsigned long long delimiter_lines = 0;
+    for (unsigned int i = MultipartParserPhase_EndOfFile; i <= MultipartParserPhase_EndOfFile_HYPHEN; i++)
+    {
+        delimiter_lines += stats->phase_bytes[i];
+    }
+
+    fprintf(stderr, "preamble_bytes: %llu\n", preamble);
+    fprintf(stderr, "header_bytes: %llu\n", (unsigned long long)stats->phase_bytes[MultipartParserPhase_SkipFileHeader]);
+    fprintf(stderr, "file_bytes: %llu\n", (unsigned long long)stats->phase_bytes[MultipartParserPhase_GetFileBytes]);
+    fprintf(stderr, "skipped_bytes: %llu\n", (unsigned long long)stats->phase_bytes[MultipartParserPhase_SkipFileBytes]);
+    fprintf(stderr, "delimiter_line_bytes: %llu\n", delimiter_lines);
+    fprintf(stderr, "epilogue_bytes: %llu\n", (unsigned long long)stats->phase_bytes[MultipartParserPhase_Epilogue]);
+    fprintf(stderr, "parts_found: %llu\n", (unsigned long long)stats->events[MultipartParserEvent_FileStreamFound]);
+    fprintf(stderr, "parts_completed: %llu\n", (unsigned long long)stats->events[MultipartParserEvent_DataStreamCompleted]);
+    fprintf(stderr, "data_events: %llu\n", (unsigned long long)stats->events[MultipartParserEvent_DataBufferAvailable]);
+    fprintf(stderr, "boundary_restarts: %llu\n", (unsigned long long)stats->boundary_restarts);
+    fprintf(stderr, "bytes_inspected: %llu\n", (unsigned long long)stats->bytes_inspected);
+    fprintf(stderr, "max_header_size: %u\n", stats->max_header_size);
+}
+#endif
+
+// Part files are named after their position and filename (or field name), keeping only characters that are safe in a path
+static char *part_path(const char *output_dir, const size_t index, const MinimalMultipartParserContext *context)
+{
+    const char *name = minimal_multipart_parser_get_part_filename(context);
+    if (name[0] == '\0')
+    {
+        name = minimal_multipart_parser_get_part_name(context);
+    }
+
+    char safe_name[MINIMAL_MULTIPART_PARSER_PART_FILENAME_MAX_CHAR + 1];
+    size_t size = 0;
+    for (; name[size] != '\0' && size < sizeof(safe_name) - 1; size++)
+    {
+        const char c = name[size];
+        const bool safe = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '_' || (c == '.' && size > 0);
+        safe_name[size] = safe ? c : '_';
+    }
+    safe_name[size] = '\0';
+
+    const size_t path_size = strlen(output_dir) + sizeof(safe_name) + 32;
+    char *path = malloc(path_size);
+    if (path)
+    {
+        snprintf(path, path_size, "%s/%06zu%s%s", output_dir, index, size > 0 ? "_" : "", safe_name);
+    }
+    return path;
+}
+
+static void on_part_begin_file(void *user_data, const MinimalMultipartParserContext *context)
+{
+    Extract *extract = user_data;
+    extract->part->path = part_path(extract->output_dir, extract->part_index, context);
+    extract->output_fd = extract->part->path ? open(extract->part->path, O_WRONLY | O_CREAT | O_TRUNC, 0644) : -1;
+    if (extract->output_fd < 0)
+    {
+        perror(extract->part->path ? extract->part->path : "malloc");
+        extract->failed = true;
+    }
+}
+
+static void on_part_end_file(void *user_data, const MinimalMultipartParserContext *context)
+{
+    Extract *extract = user_data;
+    extract->part->complete = true;
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_DIGEST
+    if (extract->digest)
+    {
+        extract->part->crc32c = minimal_multipart_parser_get_part_crc32c(context);
+        memcpy(extract->part->sha256, minimal_multipart_parser_get_part_sha256(context), sizeof(extract->part->sha256));
+    }
+#endif
+    extract->done = true;
+}
+
+// Phase one: collect the offset of every delimiter starting in one byte range of the input
+static void *locate_thread(void *argument)
+{
+    Locate *locate = argument;
+    const Parallel *parallel = locate->parallel;
+    const size_t delimiter_size = strlen(minimal_multipart_parser_get_boundary(parallel->discovery)) + 4;
+
+    // Search a little past the end so a delimiter straddling the next range is still seen whole here
+    const size_t limit = (parallel->map_size - locate->end) < delimiter_size ? parallel->map_size : locate->end + delimiter_size - 1;
+    size_t capacity = 0;
+    for (size_t offset = locate->begin; offset < locate->end;)
+    {
+        offset += minimal_multipart_parser_find_delimiter(parallel->discovery, &parallel->map[offset], limit - offset);
+        if (offset >= locate->end)
+        {
+            break;
+        }
+
+        if (locate->offset_count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 64;
+            size_t *offsets = realloc(locate->offsets, capacity * sizeof(size_t));
+            if (!offsets)
             {
-                const char rx = minimal_multipart_parser_get_data_buffer(&state)[j];
-                putc(rx, stdout);
+                locate->failed = true;
+                break;
             }
+            locate->offsets = offsets;
         }
-        else if (event == MultipartParserEvent_DataStreamCompleted)
+        locate->offsets[locate->offset_count++] = offset;
+        offset += delimiter_size;
+    }
+    return NULL;
+}
+
+// Phase two: take parts off the shared list and parse each on its own from its delimiter to the next
+static void *extract_thread(void *argument)
+{
+    Parallel *parallel = argument;
+    const char *boundary = minimal_multipart_parser_get_boundary(parallel->discovery);
+    char *buffer = malloc(WRITE_BLOCK_SIZE);
+    bool failed = (buffer == NULL);
+
+    while (!failed)
+    {
+        pthread_mutex_lock(&parallel->lock);
+        const size_t index = parallel->next_part++;
+        pthread_mutex_unlock(&parallel->lock);
+        if (index >= parallel->part_count)
         {
-            // Datastream Finished
             break;
         }
+
+        Part *part = &parallel->parts[index];
+        Extract extract = {parallel->input_fd, -1, parallel->map, parallel->map_size, false, false, parallel->output_dir, index, part, parallel->digest};
+        MinimalMultipartParserSink sink = {on_part_begin_file, on_data, on_part_end_file, &extract, buffer, WRITE_BLOCK_SIZE, 0};
+        sink.filter = parallel->filter;
+        MinimalMultipartParserContext context;
+        minimal_multipart_parser_init_with_boundary(&context, boundary, strlen(boundary));
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_DIGEST
+        context.digest.enabled = parallel->digest;
+#endif
+        minimal_multipart_parser_process_sink(&context, &sink, &parallel->map[part->start], part->end - part->start);
+
+        // Input may have ended mid part, keep what we got
+        if (!extract.done)
+        {
+            minimal_multipart_parser_sink_flush(&sink);
+        }
+        if (extract.output_fd >= 0 && close(extract.output_fd) != 0)
+        {
+            extract.failed = true;
+        }
+        failed = extract.failed;
+
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_STATS
+        pthread_mutex_lock(&parallel->lock);
+        stats_add(&parallel->stats, minimal_multipart_parser_get_stats(&context));
+        pthread_mutex_unlock(&parallel->lock);
+#endif
+    }
+
+    free(buffer);
+    return failed ? (void *)parallel : NULL;
+}
+
+static int extract_parallel(int input_fd, const char *map, const size_t map_size, const char *output_dir, unsigned int jobs, const bool digest, const bool stats,
+                            const MinimalMultipartParserFilter *filter)
+{
+    // Find the boundary and the first part the usual way
+    MinimalMultipartParserContext discovery = {0};
+    size_t first_part_end = 0;
+    for (size_t offset = 0; offset < map_size;)
+    {
+        size_t consumed = 0;
+        const MultipartParserEvent event = minimal_multipart_parser_process_buffer(&discovery, &map[offset], map_size - offset, &consumed);
+        offset += consumed;
+        if (event == MultipartParserEvent_FileStreamFound)
+        {
+            first_part_end = offset;
+            break;
+        }
+    }
+    if (first_part_end == 0)
+    {
+        return 1;
+    }
+
+    // Discovered `--BOUNDARY\r\n` line is as long as the `\r\n--BOUNDARY` delimiter
+    const size_t delimiter_size = strlen(minimal_multipart_parser_get_boundary(&discovery)) + 4;
+    const size_t search_start = first_part_end;
+    const size_t search_size = map_size - search_start;
+    if (jobs > search_size / LOCATE_MIN_RANGE_SIZE + 1)
+    {
+        jobs = (unsigned int)(search_size / LOCATE_MIN_RANGE_SIZE + 1);
+    }
+
+    Parallel parallel = {&discovery, input_fd, map, map_size, output_dir, digest, filter, NULL, 0, 0, PTHREAD_MUTEX_INITIALIZER};
+    Locate *locates = calloc(jobs, sizeof(Locate));
+    pthread_t *threads = calloc(jobs, sizeof(pthread_t));
+    unsigned int started = 0;
+    bool failed = false;
+    int result = 2;
+    if (!locates || !threads)
+    {
+        perror("calloc");
+        goto cleanup;
+    }
+
+    // Each range belongs to one thread, so all of them have to start
+    for (; started < jobs; started++)
+    {
+        locates[started].parallel = &parallel;
+        locates[started].begin = search_start + search_size / jobs * started;
+        locates[started].end = (started + 1 == jobs) ? map_size : search_start + search_size / jobs * (started + 1);
+        const int error = pthread_create(&threads[started], NULL, locate_thread, &locates[started]);
+        if (error != 0)
+        {
+            fprintf(stderr, "pthread_create: %s\n", strerror(error));
+            failed = true;
+            break;
+        }
+    }
+
+    size_t delimiter_count = 0;
+    bool out_of_memory = false;
+    for (unsigned int i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+        delimiter_count += locates[i].offset_count;
+        out_of_memory |= locates[i].failed;
+    }
+    if (failed)
+    {
+        goto cleanup;
+    }
+
+    // Ranges were searched in order, so the offsets are already sorted once joined up
+    parallel.parts = calloc(delimiter_count + 1, sizeof(Part));
+    if (out_of_memory || !parallel.parts)
+    {
+        perror("malloc");
+        goto cleanup;
+    }
+
+    size_t start = first_part_end - delimiter_size;
+    for (unsigned int i = 0; i < jobs; i++)
+    {
+        for (size_t j = 0; j < locates[i].offset_count; j++)
+        {
+            const size_t offset = locates[i].offsets[j];
+            parallel.parts[parallel.part_count++] = (Part){start, offset + delimiter_size, NULL, false};
+            start = offset;
+        }
+    }
+
+    // Whatever follows the last delimiter is a final part cut short, unless it is the close delimiter
+    const bool closed = (start + delimiter_size + 2 <= map_size) && map[start + delimiter_size] == '-' && map[start + delimiter_size + 1] == '-';
+    if (!closed)
+    {
+        parallel.parts[parallel.part_count++] = (Part){start, map_size, NULL, false};
+    }
+
+    // Workers take parts off a shared queue, so whichever of them start get through all of it
+    for (started = 0; started < jobs; started++)
+    {
+        const int error = pthread_create(&threads[started], NULL, extract_thread, &parallel);
+        if (error != 0)
+        {
+            fprintf(stderr, "pthread_create: %s\n", strerror(error));
+            break;
+        }
+    }
+    failed = (started == 0);
+    for (unsigned int i = 0; i < started; i++)
+    {
+        void *worker_result = NULL;
+        pthread_join(threads[i], &worker_result);
+        failed |= (worker_result != NULL);
+    }
+
+    // List the files written, in input order
+    bool file_received = false;
+    for (size_t i = 0; i < parallel.part_count; i++)
+    {
+        if (parallel.parts[i].path)
+        {
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_DIGEST
+            if (digest && parallel.parts[i].complete)
+            {
+                digest_print(stdout, parallel.parts[i].crc32c, parallel.parts[i].sha256);
+                printf(" ");
+            }
+#endif
+            printf("%s\n", parallel.parts[i].path);
+        }
+        file_received |= parallel.parts[i].complete;
+    }
+
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_STATS
+    if (stats)
+    {
+        // Discovery stopped at the first part, so it only adds the preamble. That part is found again by its worker.
+        MinimalMultipartParserStats preamble = *minimal_multipart_parser_get_stats(&discovery);
+        preamble.events[MultipartParserEvent_FileStreamFound] = 0;
+        stats_add(&parallel.stats, &preamble);
+        stats_print(&parallel.stats);
+    }
+#endif
+
+    if (failed)
+    {
+        fprintf(stderr, "failed to write every part\n");
+    }
+    else
+    {
+        result = file_received ? 0 : 1;
+    }
+
+cleanup:
+    for (size_t i = 0; i < parallel.part_count; i++)
+    {
+        free(parallel.parts[i].path);
+    }
+    for (unsigned int i = 0; locates && i < jobs; i++)
+    {
+        free(locates[i].offsets);
+    }
+    free(parallel.parts);
+    free(locates);
+    free(threads);
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    Extract extract = {STDIN_FILENO, STDOUT_FILENO, NULL, 0, false, false, NULL, 0, NULL, false};
+    MinimalMultipartParserSink sink = {NULL, on_data, on_part_end, &extract, write_buffer, sizeof(write_buffer), 0};
+
+    unsigned int jobs = 0;
+    const char *output_dir = NULL;
+    bool usage_error = false;
+    static const struct option long_options[] = {{"digest", no_argument, NULL, 'd'}, {"stats", no_argument, NULL, 's'}, {"part", required_argument, NULL, 'p'}, {NULL, 0, NULL, 0}};
+
+    // Each `--part` is tried both as a field name and as a filename glob. There can be no more of them than arguments
+    const char **part_names = calloc((size_t)argc, sizeof(char *));
+    MinimalMultipartParserFilter filter = {part_names, 0, part_names, 0};
+    if (!part_names)
+    {
+        perror("calloc");
+        return 2;
+    }
+    bool stats = false;
+    int option;
+    while ((option = getopt_long(argc, argv, "j:o:", long_options, NULL)) != -1)
+    {
+        switch (option)
+        {
+            case 'd':
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_DIGEST
+                extract.digest = true;
+#else
+                fprintf(stderr, "%s: built without MINIMAL_MULTIPART_PARSER_ENABLE_DIGEST\n", argv[0]);
+                usage_error = true;
+#endif
+                break;
+            case 's':
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_STATS
+                stats = true;
+#else
+                fprintf(stderr, "%s: built without MINIMAL_MULTIPART_PARSER_ENABLE_STATS\n", argv[0]);
+                usage_error = true;
+#endif
+                break;
+            case 'p':
+                part_names[filter.name_count++] = optarg;
+                filter.filename_count = filter.name_count;
+                break;
+            case 'j':
+                jobs = (unsigned int)strtoul(optarg, NULL, 10);
+                break;
+            case 'o':
+                output_dir = optarg;
+                break;
+            default:
+                usage_error = true;
+                break;
+        }
+    }
+
+    const bool parallel = (jobs > 0 || output_dir);
+    if (usage_error || argc - optind > 1 || (parallel && (jobs == 0 || !output_dir || argc - optind != 1)))
+    {
+        fprintf(stderr, "Usage: %s [--digest] [--stats] [--part NAME]... [FILE]\n", argv[0]);
+        fprintf(stderr, "       %s [--digest] [--stats] [--part NAME]... -j JOBS -o DIR FILE\n", argv[0]);
+        return 2;
+    }
+
+    if (argc - optind == 1)
+    {
+        const char *input_path = argv[optind];
+        extract.input_fd = open(input_path, O_RDONLY);
+        if (extract.input_fd < 0)
+        {
+            perror(input_path);
+            return 2;
+        }
+
+        struct stat input_stat;
+        if (fstat(extract.input_fd, &input_stat) == 0 && S_ISREG(input_stat.st_mode) && input_stat.st_size > 0)
+        {
+            void *map = mmap(NULL, (size_t)input_stat.st_size, PROT_READ, MAP_PRIVATE, extract.input_fd, 0);
+            if (map != MAP_FAILED)
+            {
+                madvise(map, (size_t)input_stat.st_size, MADV_SEQUENTIAL);
+                extract.map = map;
+                extract.map_size = (size_t)input_stat.st_size;
+            }
+        }
+
+        if (parallel)
+        {
+            if (!extract.map)
+            {
+                fprintf(stderr, "%s: parallel extraction needs a non empty regular file\n", input_path);
+                return 2;
+            }
+            return extract_parallel(extract.input_fd, extract.map, extract.map_size, output_dir, jobs, extract.digest, stats, filter.name_count > 0 ? &filter : NULL);
+        }
+    }
+
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_DIGEST
+    state.digest.enabled = extract.digest;
+#endif
+    sink.filter = filter.name_count > 0 ? &filter : NULL;
+
+    if (extract.map)
+    {
+        for (size_t offset = 0; offset < extract.map_size && !extract.done && !extract.failed;)
+        {
+            const size_t remaining = extract.map_size - offset;
+            offset += minimal_multipart_parser_process_sink(&state, &sink, &extract.map[offset], remaining < MAP_WINDOW_SIZE ? remaining : MAP_WINDOW_SIZE);
+        }
+    }
+    else
+    {
+        while (!extract.done && !extract.failed)
+        {
+            const ssize_t got = read(extract.input_fd, read_buffer, sizeof(read_buffer));
+            if (got < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (got <= 0)
+            {
+                break;
+            }
+            minimal_multipart_parser_process_sink(&state, &sink, read_buffer, (size_t)got);
+        }
+    }
+
+    // Stream may have ended mid file, pass on what we got
+    if (!extract.done)
+    {
+        minimal_multipart_parser_sink_flush(&sink);
+    }
+
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_STATS
+    if (stats)
+    {
+        stats_print(minimal_multipart_parser_get_stats(&state));
+    }
+#endif
+
+    if (extract.failed)
+    {
+        perror("write");
+        return 2;
     }
 
     // Stream ended without file?
@@ -12,7 +12,64 @@ expected_output="text default"
 
 output=$(echo -e "$input" | ./multipart_extract)
 
-if [[ "$output" == "$expected_output" ]]; then
+if [[ "$output" != "$expected_output" ]]; then
+  echo "multipart_extract test FAILED"
+  exit 1
+fi
+
+# Same again with a file path, which is memory mapped instead of read
+input_file=$(mktemp)
+trap 'rm -f "$input_file"' EXIT
+echo -e "$input" > "$input_file"
+output=$(./multipart_extract "$input_file")
+
+if [[ "$output" != "$expected_output" ]]; then
+  echo "multipart_extract test FAILED"
+  exit 1
+fi
+
+# Digest of the extracted file goes to standard error
+expected_digest="crc32c:7c10d2c3 sha256:024cc4cd04a08c6c1f2fbe9b432856fb3758b94358639a2f7dab8172f80a7cfb"
+digest=$(./multipart_extract --digest "$input_file" 2>&1 >/dev/null)
+
+if [[ "$digest" != "$expected_digest" ]]; then
+  echo "multipart_extract test FAILED"
+  exit 1
+fi
+
+# Parser counters go to standard error as well
+parts_completed=$(./multipart_extract --stats "$input_file" 2>&1 >/dev/null | grep '^parts_completed:')
+
+if [[ "$parts_completed" != "parts_completed: 1" ]]; then
+  echo "multipart_extract test FAILED"
+  exit 1
+fi
+
+# Parallel mode, every part to its own file
+output_dir=$(mktemp -d)
+selected_dir=$(mktemp -d)
+trap 'rm -f "$input_file"; rm -rf "$output_dir" "$selected_dir"' EXIT
+echo -e "preamble\r\n--AaB03x\r\n"\
+"Content-Disposition: form-data; name=\"text\"\r\n\r\n"\
+"text default\r\n--AaB03x\r\n"\
+"Content-Disposition: form-data; name=\"file\"; filename=\"../a.txt\"\r\n\r\n"\
+"Content of a.txt.\r\n--AaB03x--\r\n" > "$input_file"
+listed=$(./multipart_extract -j 2 -o "$output_dir" "$input_file" | xargs -n1 basename | tr '\n' ' ')
+
+digest=$(./multipart_extract --digest -j 2 -o "$output_dir" "$input_file" | head -n1 | cut -d' ' -f1-2)
+
+# Only the named part, the one before it is skipped over
+selected=$(./multipart_extract --part file "$input_file")
+selected_glob=$(./multipart_extract --part '*.txt' "$input_file")
+selected_listed=$(./multipart_extract --part text -j 2 -o "$selected_dir" "$input_file" | xargs -n1 basename)
+
+if [[ "$listed" == "000000_text 000001__._a.txt " ]] \
+  && [[ "$digest" == "$expected_digest" ]] \
+  && [[ "$selected" == "Content of a.txt." ]] \
+  && [[ "$selected_glob" == "Content of a.txt." ]] \
+  && [[ "$selected_listed" == "000000_text" ]] \
+  && [[ "$(cat "$output_dir/000000_text")" == "text default" ]] \
+  && [[ "$(cat "$output_dir/000001__._a.txt")" == "Content of a.txt." ]]; then
   echo "multipart_extract test PASSED"
   exit 0
 else
@@ -6,6 +6,7 @@
 //
 
 #include "minimal_multipart_parser.h"
+#include "test_support.h"
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
@@ -26,17 +27,79 @@ char *MultipartParserEvent_To_Str(MultipartParserEvent event)
             return "Data Buffer Available";
         case MultipartParserEvent_DataStreamCompleted:
             return "Data Stream Completed";
+        case MultipartParserEvent_MultipartStreamCompleted:
+            return "Multipart Stream Completed";
+        case MultipartParserEvent_LimitExceeded:
+            return "Limit Exceeded";
         default:
             return "?";
     }
 }
 
+bool test_case_buffer(const char *title, const char *input, const unsigned int input_size, const char *expected, const unsigned int expected_byte_count, MultipartParserPhase expected_end_phase, const size_t chunk_size)
+{
+    bool passed = true;
+    char received_file_buffer[1000] = {0};
+    unsigned int received_file_byte_count = 0;
+
+    MinimalMultipartParserContext state = {0};
+    size_t offset = 0;
+    while (offset < input_size)
+    {
+        const size_t remaining = input_size - offset;
+        const size_t chunk = remaining < chunk_size ? remaining : chunk_size;
+        size_t consumed = 0;
+        const MultipartParserEvent event = minimal_multipart_parser_process_buffer(&state, &input[offset], chunk, &consumed);
+        offset += consumed;
+        if (event == MultipartParserEvent_DataBufferAvailable)
+        {
+            for (unsigned int j = 0; j < minimal_multipart_parser_get_data_size(&state); j++)
+            {
+                received_file_buffer[received_file_byte_count++] = minimal_multipart_parser_get_data_buffer(&state)[j];
+            }
+        }
+        else if (event == MultipartParserEvent_DataStreamCompleted)
+        {
+            break;
+        }
+    }
+
+    if (state.phase != expected_end_phase || received_file_byte_count != expected_byte_count)
+    {
+        passed = false;
+    }
+
+    if (expected_byte_count != 0 && memcmp(expected, received_file_buffer, expected_byte_count) != 0)
+    {
+        passed = false;
+    }
+
+    if (!passed)
+    {
+        printf("Case '%s' (buffer api, %zu byte chunks) Failed\n", title, chunk_size);
+        printf("Expected (%d): '%s'\n", expected_byte_count, expected);
+        printf("Got (%d): '%s'\n", received_file_byte_count, received_file_buffer);
+        printf("\n");
+    }
+    return passed;
+}
+
 bool test_case(const char *title, const char *input, const unsigned int input_size, const char *expected, const unsigned int expected_byte_count, MultipartParserPhase expected_end_phase)
 {
     bool passed = true;
     char received_file_buffer[1000] = {0};
     unsigned int received_file_byte_count = 0;
 
+    // The buffer api must give the same result no matter how the stream is chunked
+    const size_t chunk_sizes[] = {1, 2, 7, 64, input_size};
+    for (unsigned int i = 0; i < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); i++)
+    {
+        if (!test_case_buffer(title, input, input_size, expected, expected_byte_count, expected_end_phase, chunk_sizes[i]))
+        {
+            passed = false;
+        }
+    }
+
     MinimalMultipartParserContext state = {0};
     for (int i = 0; i < input_size; i++)
     {
@@ -233,41 +296,1659 @@ bool test_case6(void)
     return test_case("No file stream found", input, strlen(input), NULL, 0, MultipartParserPhase_Preamble_SKIP_LINE);
 }
 
-int main(int argc, char **argv)
+bool test_case7(void)
 {
-    printf("Testing Minimal Multipart Form Data Parser\n");
-    printf("GCC Version: v%s\n", __VERSION__);
+    // Long enough to run through the vectorised scanner, with lone '\r' and partial boundaries at varying offsets
+    const char input[] = "-----------------------------9051914041544843365972754266\r\n"
+                         "Content-Disposition: form-data; name=\"text\"\r\n"
+                         "\r\n"
+                         "0123456789abcde\r0123456789abcdef\r\n0123456789abcd\r\n-0123456789abcdefghijklmnopqrstuvwxyz\r\n--\r\n"
+                         "\r\n-----------------------------9051914041544843365972754265\r\r\r\n\r\n\r\n"
+                         "0123456789abcdefghijklmnopqrstuvwxyz0123456789abcdefghijklmnopqrstuvwxyz0123456789"
+                         "\r\n"
+                         "-----------------------------9051914041544843365972754266--\r\n";
 
-    if (!test_case1())
+    const char expected[] = "0123456789abcde\r0123456789abcdef\r\n0123456789abcd\r\n-0123456789abcdefghijklmnopqrstuvwxyz\r\n--\r\n"
+                            "\r\n-----------------------------9051914041544843365972754265\r\r\r\n\r\n\r\n"
+                            "0123456789abcdefghijklmnopqrstuvwxyz0123456789abcdefghijklmnopqrstuvwxyz0123456789";
+
+    return test_case("boundary near misses", input, sizeof(input) - 1, expected, sizeof(expected) - 1, MultipartParserPhase_EndOfFile);
+}
+
+bool test_zero_copy_slices(void)
+{
+    const char input[] = "-----------------------------9051914041544843365972754266\r\n"
+                         "Content-Disposition: form-data; name=\"text\"\r\n"
+                         "\r\n"
+                         "first line\r\n"
+                         "-second line\r\n"
+                         "-----------------------------9051914041544843365972754266--\r\n";
+
+    const char expected[] = "first line\r\n-second line";
+
+    // Boundary free runs should come straight out of the input buffer as one view each.
+    // Input is split in two chunks just after a partial boundary, which is the only case that needs a copy.
+    const size_t split = (size_t)(strstr(input, "first line") - input) + strlen("first line\r\n-");
+    bool passed = true;
+    unsigned int data_events = 0;
+    char received[100] = {0};
+    unsigned int received_count = 0;
+    MinimalMultipartParserContext state = {0};
+    size_t offset = 0;
+    while (offset < sizeof(input) - 1)
     {
-        return 1;
+        const size_t chunk_end = offset < split ? split : sizeof(input) - 1;
+        size_t consumed = 0;
+        const MultipartParserEvent event = minimal_multipart_parser_process_buffer(&state, &input[offset], chunk_end - offset, &consumed);
+        offset += consumed;
+        if (event == MultipartParserEvent_DataBufferAvailable)
+        {
+            const char *view = minimal_multipart_parser_get_data_buffer(&state);
+            const unsigned int view_size = minimal_multipart_parser_get_data_size(&state);
+            if ((view < input || view + view_size > input + sizeof(input)) && view != state.data.buffer && view != state.boundary.string.buffer)
+            {
+                // Only held back partial boundary matches may be copied
+                passed = false;
+            }
+            memcpy(&received[received_count], view, view_size);
+            received_count += view_size;
+            data_events++;
+        }
+        else if (event == MultipartParserEvent_DataStreamCompleted)
+        {
+            break;
+        }
     }
 
-    if (!test_case2())
+    // 'first line', '\r\n-s' (held back as a possible boundary then released) and 'econd line'
+    if (data_events != 3 || received_count != strlen(expected) || memcmp(received, expected, received_count) != 0)
     {
-        return 1;
+        passed = false;
     }
 
-    if (!test_case3())
+    printf("Case 'zero copy slices' %s\n", passed ? "Passed" : "Failed");
+    return passed;
+}
+
+// Collects every part of a stream with a fresh context through the per char api (chunk_size 0) or the chunk api. The boundary is
+// taken from content_type if given, otherwise the parser has to find it.
+static size_t collect_parts(const char *content_type, const char *input, const size_t input_size, const size_t chunk_size, CollectedParts *collected)
+{
+    MinimalMultipartParserContext state = {0};
+    if (content_type && !minimal_multipart_parser_init_from_content_type(&state, content_type, strlen(content_type)))
     {
-        return 1;
+        return 0;
     }
+    return test_collect_parts(&state, COLLECT_EVENTS, input, input_size, chunk_size, collected);
+}
 
-    if (!test_case4())
+bool test_multipart_iteration(void)
+{
+    const char input[] = "Preamble text\r\n"
+                         "-----------------------------9051914041544843365972754266\r\n"
+                         "Content-Disposition: form-data; name=\"text\"\r\n"
+                         "\r\n"
+                         "text default\r\n"
+                         "-----------------------------9051914041544843365972754266\r\n"
+                         "Content-Disposition: form-data; name=\"file1\"; filename=\"a.txt\"\r\n"
+                         "Content-Type: text/plain\r\n"
+                         "\r\n"
+                         "Content of a.txt.\r\n"
+                         "\r\n"
+                         "-----------------------------9051914041544843365972754266\r\n"
+                         "Content-Disposition: form-data; name=\"file2\"; filename=\"a.html\"\r\n"
+                         "Content-Type: text/html\r\n"
+                         "\r\n"
+                         "<!DOCTYPE html><title>Content of a.html.</title>\r\n"
+                         "\r\n"
+                         "-----------------------------9051914041544843365972754266--\r\n"
+                         "Epilogue text\r\n"
+                         "-----------------------------9051914041544843365972754266\r\n"
+                         "\r\n"
+                         "Not a part\r\n";
+
+    const char expected[] = "text default|Content of a.txt.\r\n|<!DOCTYPE html><title>Content of a.html.</title>\r\n|";
+
+    bool passed = true;
+    const size_t chunk_sizes[] = {0, 1, 5, 64, sizeof(input)};
+    for (unsigned int i = 0; i < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); i++)
     {
-        return 1;
+        CollectedParts received = {0};
+        const size_t received_count = collect_parts(NULL, input, sizeof(input) - 1, chunk_sizes[i], &received);
+        if (!received.multipart_completed || received_count != strlen(expected) || memcmp(received.out, expected, received_count) != 0)
+        {
+            printf("Case 'multipart iteration' (%zu byte chunks) Failed\n", chunk_sizes[i]);
+            printf("Expected: '%s'\n", expected);
+            printf("Got: '%s'\n", received.out);
+            passed = false;
+        }
     }
 
-    if (!test_case5())
+    if (passed)
     {
-        return 1;
+        printf("Case 'multipart iteration' Passed\n");
     }
+    return passed;
+}
 
-    if (!test_case6())
+bool test_part_headers(void)
+{
+    const char input[] = "-----------------------------9051914041544843365972754266\r\n"
+                         "Content-Disposition: form-data; name=\"text\"\r\n"
+                         "\r\n"
+                         "text default\r\n"
+                         "-----------------------------9051914041544843365972754266\r\n"
+                         "content-type: Text/Plain; charset=utf-8\r\n"
+                         "X-Unrelated: name=\"nope\"\r\n"
+                         "CONTENT-DISPOSITION: form-data; filename*=UTF-8''b.txt; FileName=\"a \\\"quoted\\\".txt\"; name=file1\r\n"
+                         "\r\n"
+                         "Content of a.txt.\r\n"
+                         "-----------------------------9051914041544843365972754266\r\n"
+                         "Content-Disposition: form-data; name=\"a_name_that_is_far_too_long_to_fit_in_the_name_field\"\r\n"
+                         "\r\n"
+                         "x\r\n"
+                         "-----------------------------9051914041544843365972754266\r\n"
+                         "\r\n"
+                         "no headers\r\n"
+                         "-----------------------------9051914041544843365972754266--\r\n";
+
+    const char expected[] = "text||;"
+                            "file1|a \"quoted\".txt|Text/Plain;"
+                            "a_name_that_is_far_too_long_to_f||;"
+                            "||;";
+
+    bool passed = true;
+    const size_t chunk_sizes[] = {0, 1, 3, sizeof(input)};
+    for (unsigned int i = 0; i < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); i++)
     {
-        return 1;
+        char received[1000] = {0};
+        MinimalMultipartParserContext state = {0};
+        size_t offset = 0;
+        while (offset < sizeof(input) - 1)
+        {
+            MultipartParserEvent event;
+            if (chunk_sizes[i] == 0)
+            {
+                event = minimal_multipart_parser_process(&state, input[offset++]);
+            }
+            else
+            {
+                const size_t remaining = sizeof(input) - 1 - offset;
+                size_t consumed = 0;
+                event = minimal_multipart_parser_process_buffer(&state, &input[offset], remaining < chunk_sizes[i] ? remaining : chunk_sizes[i], &consumed);
+                offset += consumed;
+            }
+
+            if (event == MultipartParserEvent_FileStreamStarting)
+            {
+                // Headers must be known before the body starts
+                sprintf(received + strlen(received), "%s|%s|%s;", minimal_multipart_parser_get_part_name(&state), minimal_multipart_parser_get_part_filename(&state),
+                        minimal_multipart_parser_get_part_content_type(&state));
+            }
+        }
+
+        if (strcmp(received, expected) != 0)
+        {
+            printf("Case 'part headers' (%zu byte chunks) Failed\n", chunk_sizes[i]);
+            printf("Expected: '%s'\n", expected);
+            printf("Got: '%s'\n", received);
+            passed = false;
+        }
+    }
+
+    if (passed)
+    {
+        printf("Case 'part headers' Passed\n");
+    }
+    return passed;
+}
+
+bool test_init_from_content_type(void)
+{
+    // A preamble line starting with '--' would be taken as the boundary if the parser had to find it itself
+    const char input[] = "--not the boundary\r\n"
+                         "\r\n"
+                         "-----------------------------9051914041544843365972754266\r\n"
+                         "Content-Disposition: form-data; name=\"text\"\r\n"
+                         "\r\n"
+                         "text default\r\n"
+                         "-----------------------------9051914041544843365972754266\r\n"
+                         "Content-Disposition: form-data; name=\"file1\"; filename=\"a.txt\"\r\n"
+                         "\r\n"
+                         "Content of a.txt.\r\n"
+                         "-----------------------------9051914041544843365972754266--\r\n";
+
+    const char *content_types[] = {
+        "multipart/form-data; boundary=---------------------------9051914041544843365972754266",
+        "multipart/form-data; charset=\"a;boundary=x\"; BOUNDARY=\"---------------------------9051914041544843365972754266\"",
+    };
+
+    const char expected[] = "text default|Content of a.txt.|";
+
+    bool passed = true;
+    const size_t chunk_sizes[] = {0, 1, 4, sizeof(input)};
+    for (unsigned int i = 0; i < sizeof(content_types) / sizeof(content_types[0]); i++)
+    {
+        for (unsigned int j = 0; j < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); j++)
+        {
+            CollectedParts received = {0};
+            const size_t received_count = collect_parts(content_types[i], input, sizeof(input) - 1, chunk_sizes[j], &received);
+            if (!received.multipart_completed || received_count != strlen(expected) || memcmp(received.out, expected, received_count) != 0)
+            {
+                printf("Case 'init from content type' (%s, %zu byte chunks) Failed\n", content_types[i], chunk_sizes[j]);
+                printf("Expected: '%s'\n", expected);
+                printf("Got: '%s'\n", received.out);
+                passed = false;
+            }
+        }
+    }
+
+    // Body starting right at the first delimiter, with no CRLF in front of it
+    CollectedParts received = {0};
+    const char body_only[] = "--AaB03x\r\n\r\nx\r\n--AaB03x--";
+    if (collect_parts("multipart/form-data; boundary=AaB03x", body_only, strlen(body_only), 3, &received) != 2 || !received.multipart_completed)
+    {
+        printf("Case 'init from content type' (body only) Failed\n");
+        passed = false;
+    }
+
+    // Missing or invalid boundaries
+    MinimalMultipartParserContext state = {0};
+    const char *invalid[] = {"multipart/form-data", "multipart/form-data; boundary=", "multipart/form-data; boundary=\"\"", "text/plain; xboundary=abc",
+                             "multipart/form-data; boundary=01234567890123456789012345678901234567890123456789012345678901234567890"};
+    for (unsigned int i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+    {
+        if (minimal_multipart_parser_init_from_content_type(&state, invalid[i], strlen(invalid[i])))
+        {
+            printf("Case 'init from content type' (%s) Failed\n", invalid[i]);
+            passed = false;
+        }
+    }
+
+    if (passed)
+    {
+        printf("Case 'init from content type' Passed\n");
+    }
+    return passed;
+}
+
+bool test_case8(void)
+{
+    // '\r' right before the delimiter used to hide it, as the partial match was restarted without looking at that byte again
+    const char input[] = "-----------------------------9051914041544843365972754266\r\n"
+                         "Content-Disposition: form-data; name=\"text\"\r\n"
+                         "\r\n"
+                         "a\r\r\r\n\r\n-\r\n--\r\r"
+                         "\r\n"
+                         "-----------------------------9051914041544843365972754266--\r\n";
+
+    const char expected[] = "a\r\r\r\n\r\n-\r\n--\r\r";
+
+    return test_case("carriage return before boundary", input, sizeof(input) - 1, expected, sizeof(expected) - 1, MultipartParserPhase_EndOfFile);
+}
+
+// Naive reference splitter for a stream of header-less parts, using the same '|' after each part as collect_parts()
+static unsigned int naive_split(const char *input, const size_t input_size, const char *delimiter, const size_t delimiter_size, char *out)
+{
+    unsigned int out_count = 0;
+    // Stream opens with `--BOUNDARY\r\n\r\n`, i.e. the delimiter without its CRLF and an empty header block
+    size_t offset = delimiter_size - 2 + 4;
+    while (offset <= input_size)
+    {
+        const size_t end = offset + naive_find(&input[offset], input_size - offset, delimiter, delimiter_size);
+        if (end >= input_size)
+        {
+            break;
+        }
+        memcpy(&out[out_count], &input[offset], end - offset);
+        out_count += end - offset;
+        out[out_count++] = '|';
+        offset = end + delimiter_size;
+        if (input[offset] == '-')
+        {
+            break;
+        }
+        offset += 4;
+    }
+    out[out_count] = '\0';
+    return out_count;
+}
+
+bool test_boundary_fuzz(void)
+{
+    // Random parts built mostly out of the delimiter's own chars, so there are plenty of near misses.
+    // Parser output must match the naive splitter whatever the api and however the stream is chunked.
+    const char delimiter[] = "\r\n--a-b";
+    const char alphabet[] = "\r\n--a-bx";
+    bool passed = true;
+    for (unsigned int round = 0; round < 2000 && passed; round++)
+    {
+        char input[600];
+        size_t input_size = 0;
+        memcpy(&input[input_size], "--a-b\r\n\r\n", 9);
+        input_size += 9;
+        const unsigned int part_count = 1 + prng() % 3;
+        for (unsigned int part = 0; part < part_count; part++)
+        {
+            const size_t part_start = input_size;
+            const unsigned int part_size = prng() % 150;
+            for (unsigned int i = 0; i < part_size; i++)
+            {
+                input[input_size++] = alphabet[prng() % (sizeof(alphabet) - 1)];
+                if (naive_find(&input[part_start], input_size - part_start, delimiter, sizeof(delimiter) - 1) < input_size - part_start)
+                {
+                    // Generated a real delimiter, drop its last byte
+                    input_size--;
+                }
+            }
+            const char *next = (part + 1 < part_count) ? "\r\n--a-b\r\n\r\n" : "\r\n--a-b--\r\n";
+            memcpy(&input[input_size], next, strlen(next));
+            input_size += strlen(next);
+        }
+
+        char expected[600];
+        const unsigned int expected_count = naive_split(input, input_size, delimiter, sizeof(delimiter) - 1, expected);
+
+        // 0 is the per char api, the rest use the chunk api
+        const size_t chunk_sizes[] = {0, 1, 1 + prng() % 8, 1 + prng() % 64, input_size};
+        for (unsigned int i = 0; i < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); i++)
+        {
+            for (unsigned int with_content_type = 0; with_content_type < 2; with_content_type++)
+            {
+                CollectedParts received = {0};
+                const size_t received_count = collect_parts(with_content_type ? "multipart/form-data; boundary=a-b" : NULL, input, input_size, chunk_sizes[i], &received);
+                if (!received.multipart_completed || received_count != expected_count || memcmp(received.out, expected, expected_count) != 0)
+                {
+                    printf("Case 'boundary fuzz' (round %u, %zu byte chunks) Failed\n", round, chunk_sizes[i]);
+                    passed = false;
+                }
+            }
+        }
+    }
+
+    if (passed)
+    {
+        printf("Case 'boundary fuzz' Passed\n");
+    }
+    return passed;
+}
+
+typedef struct SinkTestState
+{
+    char received[4000];
+    unsigned int received_count;
+    unsigned int data_calls;
+} SinkTestState;
+
+static void sink_test_on_part_begin(void *user_data, const MinimalMultipartParserContext *context)
+{
+    SinkTestState *sink_state = user_data;
+    sink_state->received_count += sprintf(&sink_state->received[sink_state->received_count], "<%s>", minimal_multipart_parser_get_part_name(context));
+}
+
+static void sink_test_on_data(void *user_data, const char *data, const size_t size)
+{
+    SinkTestState *sink_state = user_data;
+    memcpy(&sink_state->received[sink_state->received_count], data, size);
+    sink_state->received_count += size;
+    sink_state->data_calls++;
+}
+
+static void sink_test_on_part_end(void *user_data, const MinimalMultipartParserContext *context)
+{
+    SinkTestState *sink_state = user_data;
+    sink_state->received[sink_state->received_count++] = '|';
+}
+
+bool test_sink(void)
+{
+    const char input[] = "-----------------------------9051914041544843365972754266\r\n"
+                         "Content-Disposition: form-data; name=\"text\"\r\n"
+                         "\r\n"
+                         "text default\r\n"
+                         "-----------------------------9051914041544843365972754266\r\n"
+                         "Content-Disposition: form-data; name=\"file1\"; filename=\"a.txt\"\r\n"
+                         "\r\n"
+                         "Content\r\n of\r\n a.txt.\r\n\r\n"
+                         "\r\n"
+                         "-----------------------------9051914041544843365972754266--\r\n";
+
+    const char expected[] = "<text>text default|<file1>Content\r\n of\r\n a.txt.\r\n\r\n|";
+
+    bool passed = true;
+    const size_t buffer_sizes[] = {0, 4, 16, 64};
+    const size_t chunk_sizes[] = {1, 5, sizeof(input)};
+    for (unsigned int i = 0; i < sizeof(buffer_sizes) / sizeof(buffer_sizes[0]); i++)
+    {
+        for (unsigned int j = 0; j < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); j++)
+        {
+            char scratch[64];
+            SinkTestState sink_state = {0};
+            MinimalMultipartParserSink sink = {sink_test_on_part_begin, sink_test_on_data, sink_test_on_part_end, &sink_state, buffer_sizes[i] ? scratch : NULL, buffer_sizes[i], 0};
+            MinimalMultipartParserContext state = {0};
+            for (size_t offset = 0; offset < sizeof(input) - 1;)
+            {
+                const size_t remaining = sizeof(input) - 1 - offset;
+                offset += minimal_multipart_parser_process_sink(&state, &sink, &input[offset], remaining < chunk_sizes[j] ? remaining : chunk_sizes[j]);
+            }
+
+            // With a scratch buffer, data is only handed over in batches: at most one short batch per part
+            const unsigned int batch_limit = 2 + (sizeof(expected) - 1) / (buffer_sizes[i] ? buffer_sizes[i] : 1);
+            if (sink_state.received_count != strlen(expected) || memcmp(sink_state.received, expected, sink_state.received_count) != 0 ||
+                (buffer_sizes[i] && sink_state.data_calls > batch_limit))
+            {
+                printf("Case 'sink' (%zu byte buffer, %zu byte chunks) Failed\n", buffer_sizes[i], chunk_sizes[j]);
+                printf("Expected: '%s'\n", expected);
+                printf("Got (%u calls): '%.*s'\n", sink_state.data_calls, (int)sink_state.received_count, sink_state.received);
+                passed = false;
+            }
+        }
     }
 
+    if (passed)
+    {
+        printf("Case 'sink' Passed\n");
+    }
+    return passed;
+}
+
+// Downstream that takes `capacity` bytes and then has to be drained before it takes any more
+typedef struct PauseTestState
+{
+    SinkTestState received;
+    MinimalMultipartParserSink *sink;
+    size_t capacity;
+    size_t queued;
+    unsigned int pauses;
+} PauseTestState;
+
+static void pause_test_on_data(void *user_data, const char *data, const size_t size)
+{
+    PauseTestState *pause_state = user_data;
+    sink_test_on_data(&pause_state->received, data, size);
+    pause_state->queued += size;
+    if (pause_state->queued >= pause_state->capacity)
+    {
+        pause_state->sink->paused = true;
+    }
+}
+
+static void pause_test_on_part_end(void *user_data, const MinimalMultipartParserContext *context)
+{
+    PauseTestState *pause_state = user_data;
+    sink_test_on_part_end(&pause_state->received, context);
+}
+
+bool test_sink_pause(void)
+{
+    // Near misses of the delimiter, so pauses land midway through a partial match
+    const char input[] = "--AaB03x\r\n"
+                         "Content-Disposition: form-data; name=\"file\"\r\n"
+                         "\r\n"
+                         "abc\r\n--AaB03 def\r\n--AaB0\r\r\n--AaB03y-ghi\r\n--\r\n-"
+                         "0123456789012345678901234567890123456789\r\n"
+                         "--AaB03x\r\n"
+                         "\r\n"
+                         "second\r\n--AaB03\r\n"
+                         "--AaB03x--\r\n";
+    const char expected[] = "abc\r\n--AaB03 def\r\n--AaB0\r\r\n--AaB03y-ghi\r\n--\r\n-0123456789012345678901234567890123456789|second\r\n--AaB03|";
+
+    bool passed = true;
+    const size_t buffer_sizes[] = {0, 4, 16};
+    const size_t capacities[] = {1, 3, 10};
+    const size_t chunk_sizes[] = {1, 7, sizeof(input) - 1};
+    for (unsigned int b = 0; b < sizeof(buffer_sizes) / sizeof(buffer_sizes[0]); b++)
+    {
+        for (unsigned int c = 0; c < sizeof(capacities) / sizeof(capacities[0]); c++)
+        {
+            for (unsigned int k = 0; k < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); k++)
+            {
+                char scratch[16];
+                PauseTestState pause_state = {{{0}}, NULL, capacities[c], 0, 0};
+                MinimalMultipartParserSink sink = {NULL, pause_test_on_data, pause_test_on_part_end, &pause_state, buffer_sizes[b] ? scratch : NULL, buffer_sizes[b], 0};
+                pause_state.sink = &sink;
+                MinimalMultipartParserContext state = {0};
+                for (size_t offset = 0; offset < sizeof(input) - 1;)
+                {
+                    // Like an event loop: feed a chunk, and if the sink pauses, drain downstream and resume with the rest of it
+                    const size_t remaining = sizeof(input) - 1 - offset;
+                    const size_t chunk = remaining < chunk_sizes[k] ? remaining : chunk_sizes[k];
+                    for (size_t used = 0; used < chunk;)
+                    {
+                        used += minimal_multipart_parser_process_sink(&state, &sink, &input[offset + used], chunk - used);
+                        if (sink.paused)
+                        {
+                            pause_state.pauses++;
+                            pause_state.queued = 0;
+                        }
+                    }
+                    offset += chunk;
+                }
+
+                if (pause_state.received.received_count != sizeof(expected) - 1 || memcmp(pause_state.received.received, expected, sizeof(expected) - 1) != 0 ||
+                    pause_state.pauses == 0 || !minimal_multipart_parser_is_multipart_completed(&state))
+                {
+                    printf("Case 'sink pause' (%zu byte buffer, %zu byte capacity, %zu byte chunks) Failed\n", buffer_sizes[b], capacities[c], chunk_sizes[k]);
+                    printf("Expected: '%s'\n", expected);
+                    printf("Got (%u pauses): '%.*s'\n", pause_state.pauses, (int)pause_state.received.received_count, pause_state.received.received);
+                    passed = false;
+                }
+            }
+        }
+    }
+
+    if (passed)
+    {
+        printf("Case 'sink pause' Passed\n");
+    }
+    return passed;
+}
+
+bool test_find_delimiter(void)
+{
+    // Random near miss heavy input, every offset must agree with a naive search whatever range is searched
+    const char delimiter[] = "\r\n--a-b";
+    const char alphabet[] = "\r\n--a-bx";
+    bool passed = true;
+
+    MinimalMultipartParserContext state = {0};
+    if (minimal_multipart_parser_find_delimiter(&state, delimiter, sizeof(delimiter) - 1) != sizeof(delimiter) - 1)
+    {
+        printf("Case 'find delimiter' (boundary not known yet) Failed\n");
+        passed = false;
+    }
+    minimal_multipart_parser_init_with_boundary(&state, "a-b", 3);
+    if (strcmp(minimal_multipart_parser_get_boundary(&state), "a-b") != 0)
+    {
+        printf("Case 'find delimiter' (get boundary) Failed\n");
+        passed = false;
+    }
+
+    for (unsigned int round = 0; round < 2000 && passed; round++)
+    {
+        char input[300];
+        const size_t input_size = prng() % sizeof(input);
+        for (size_t i = 0; i < input_size; i++)
+        {
+            input[i] = alphabet[prng() % (sizeof(alphabet) - 1)];
+        }
+        for (unsigned int planted = prng() % 3; planted > 0 && input_size >= sizeof(delimiter); planted--)
+        {
+            memcpy(&input[prng() % (input_size - sizeof(delimiter) + 2)], delimiter, sizeof(delimiter) - 1);
+        }
+
+        const size_t start = input_size ? prng() % input_size : 0;
+        const size_t expected = start + naive_find(&input[start], input_size - start, delimiter, sizeof(delimiter) - 1);
+        const size_t found = start + minimal_multipart_parser_find_delimiter(&state, &input[start], input_size - start);
+        if (found != expected)
+        {
+            printf("Case 'find delimiter' (round %u) Failed, expected %zu got %zu\n", round, expected, found);
+            passed = false;
+        }
+    }
+
+    if (passed)
+    {
+        printf("Case 'find delimiter' Passed\n");
+    }
+    return passed;
+}
+
+bool test_reset(void)
+{
+    const char body[] = "--AaB03x\r\n"
+                        "Content-Disposition: form-data; name=\"text\"\r\n"
+                        "\r\n"
+                        "text default\r\n"
+                        "--AaB03x\r\n"
+                        "Content-Disposition: form-data; name=\"file1\"; filename=\"a.txt\"\r\n"
+                        "\r\n"
+                        "Content of a.txt.\r\n"
+                        "--AaB03x--\r\n";
+    // Would be taken as the boundary if the parser had to find it again
+    const char body_with_preamble[] = "--not the boundary\r\n"
+                                      "--AaB03x\r\n"
+                                      "\r\n"
+                                      "x\r\n"
+                                      "--AaB03x--\r\n";
+    const char other_body[] = "--other\r\n\r\ny\r\n--other--\r\n";
+    const char content_type[] = "multipart/form-data; boundary=AaB03x";
+    const char other_content_type[] = "multipart/form-data; boundary=other";
+
+    bool passed = true;
+    CollectedParts received = {0};
+
+    // Boundary found in the first body is kept for the next one
+    MinimalMultipartParserContext state = {0};
+    test_collect_parts(&state, COLLECT_EVENTS, body, strlen(body), 0, &received);
+    minimal_multipart_parser_reset(&state);
+    received = (CollectedParts){0};
+    test_collect_parts(&state, COLLECT_EVENTS, body_with_preamble, strlen(body_with_preamble), 0, &received);
+    if (strcmp(received.out, "x|") != 0 || !received.multipart_completed || minimal_multipart_parser_get_parts_completed(&state) != 1)
+    {
+        printf("Case 'reset' (keeps found boundary) Failed, got '%s'\n", received.out);
+        passed = false;
+    }
+
+    // Request dropped mid part, the next one starts clean
+    minimal_multipart_parser_reset(&state);
+    test_collect_parts(&state, COLLECT_EVENTS, body, 100, 7, &received);
+    minimal_multipart_parser_reset(&state);
+    received = (CollectedParts){0};
+    test_collect_parts(&state, COLLECT_EVENTS, body, strlen(body), 7, &received);
+    if (strcmp(received.out, "text default|Content of a.txt.|") != 0 || !received.multipart_completed || strcmp(minimal_multipart_parser_get_part_filename(&state), "a.txt") != 0)
+    {
+        printf("Case 'reset' (mid part) Failed, got '%s'\n", received.out);
+        passed = false;
+    }
+
+    // Same boundary in the next request's header keeps the search table, a different one replaces it
+    const MinimalMultipartParserBoundary boundary = state.boundary;
+    if (!minimal_multipart_parser_reset_from_content_type(&state, content_type, strlen(content_type)) || memcmp(&boundary, &state.boundary, sizeof(boundary)) != 0 ||
+        state.phase != MultipartParserPhase_Preamble_SeekBoundary)
+    {
+        printf("Case 'reset' (same content type) Failed\n");
+        passed = false;
+    }
+    if (!minimal_multipart_parser_reset_from_content_type(&state, other_content_type, strlen(other_content_type)) ||
+        strcmp(minimal_multipart_parser_get_boundary(&state), "other") != 0)
+    {
+        printf("Case 'reset' (other content type) Failed\n");
+        passed = false;
+    }
+    received = (CollectedParts){0};
+    test_collect_parts(&state, COLLECT_EVENTS, other_body, strlen(other_body), 3, &received);
+    if (strcmp(received.out, "y|") != 0 || minimal_multipart_parser_reset_from_content_type(&state, "text/plain", 10))
+    {
+        printf("Case 'reset' (other body) Failed, got '%s'\n", received.out);
+        passed = false;
+    }
+
+    // Nothing to keep before a boundary is known
+    MinimalMultipartParserContext fresh = {0};
+    test_collect_parts(&fresh, COLLECT_EVENTS, "--Aa", 4, 0, &received);
+    minimal_multipart_parser_reset(&fresh);
+    if (fresh.phase != MultipartParserPhase_INIT || fresh.boundary.string.count != 0)
+    {
+        printf("Case 'reset' (no boundary yet) Failed\n");
+        passed = false;
+    }
+
+    if (passed)
+    {
+        printf("Case 'reset' Passed\n");
+    }
+    return passed;
+}
+
+// Reference MIME base64 encoder, with a line break every 76 chars
+static size_t base64_encode(const unsigned char *in, const size_t size, char *out)
+{
+    const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t count = 0;
+    for (size_t i = 0; i < size; i += 3)
+    {
+        const unsigned int bits = (in[i] << 16) | ((i + 1 < size ? in[i + 1] : 0) << 8) | (i + 2 < size ? in[i + 2] : 0);
+        out[count++] = alphabet[(bits >> 18) & 63];
+        out[count++] = alphabet[(bits >> 12) & 63];
+        out[count++] = (i + 1 < size) ? alphabet[(bits >> 6) & 63] : '=';
+        out[count++] = (i + 2 < size) ? alphabet[bits & 63] : '=';
+        if ((i / 3 + 1) % 19 == 0 && i + 3 < size)
+        {
+            out[count++] = '\r';
+            out[count++] = '\n';
+        }
+    }
+    return count;
+}
+
+static void encoding_test_on_part_begin(void *user_data, const MinimalMultipartParserContext *context)
+{
+    SinkTestState *sink_state = user_data;
+    sink_state->received_count += sprintf(&sink_state->received[sink_state->received_count], "<%d>", minimal_multipart_parser_get_part_transfer_encoding(context));
+}
+
+bool test_transfer_encoding(void)
+{
+    unsigned char binary[1000];
+    for (unsigned int i = 0; i < sizeof(binary); i++)
+    {
+        binary[i] = (unsigned char)prng();
+    }
+
+    char input[3000];
+    size_t input_size = 0;
+    input_size += sprintf(&input[input_size], "--AaB03x\r\nContent-Disposition: form-data; name=\"file\"\r\nContent-Transfer-Encoding: BASE64\r\n\r\n");
+    input_size += base64_encode(binary, sizeof(binary), &input[input_size]);
+    input_size += sprintf(&input[input_size], "\r\n--AaB03x\r\ncontent-transfer-encoding:  quoted-printable ; x\r\n\r\n"
+                                              "caf=C3=A9 =\r\nsoft=3d break =ZZ =\r =4 end=\r\n"
+                                              "--AaB03x\r\nContent-Transfer-Encoding: base64x\r\n\r\n"
+                                              "not=decoded\r\n"
+                                              "--AaB03x\r\nContent-Transfer-Encoding: base64\r\n\r\n"
+                                              "aGVsbG8=\r\naGk\r\n"
+                                              "--AaB03x--\r\n");
+
+    char expected[3000];
+    size_t expected_size = sprintf(expected, "<1>");
+    memcpy(&expected[expected_size], binary, sizeof(binary));
+    expected_size += sizeof(binary);
+    expected_size += sprintf(&expected[expected_size], "|<2>caf\xC3\xA9 soft= break =ZZ  =4 end=|<0>not=decoded|<1>hellohi|");
+
+    bool passed = true;
+    const size_t buffer_sizes[] = {0, 8, 64, 1000};
+    const size_t chunk_sizes[] = {1, 7, 100, input_size};
+    for (unsigned int i = 0; i < sizeof(buffer_sizes) / sizeof(buffer_sizes[0]); i++)
+    {
+        for (unsigned int j = 0; j < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); j++)
+        {
+            char scratch[1000];
+            SinkTestState sink_state = {0};
+            MinimalMultipartParserSink sink = {encoding_test_on_part_begin, sink_test_on_data, sink_test_on_part_end, &sink_state, buffer_sizes[i] ? scratch : NULL, buffer_sizes[i], 0};
+            sink.decode = true;
+            MinimalMultipartParserContext state = {0};
+            for (size_t offset = 0; offset < input_size;)
+            {
+                const size_t remaining = input_size - offset;
+                offset += minimal_multipart_parser_process_sink(&state, &sink, &input[offset], remaining < chunk_sizes[j] ? remaining : chunk_sizes[j]);
+            }
+
+            if (sink_state.received_count != expected_size || memcmp(sink_state.received, expected, expected_size) != 0)
+            {
+                printf("Case 'transfer encoding' (%zu byte buffer, %zu byte chunks) Failed\n", buffer_sizes[i], chunk_sizes[j]);
+                printf("Expected tail: '%s'\n", &expected[sizeof(binary) + 3]);
+                printf("Got (%u bytes): '%.*s'\n", sink_state.received_count, (int)sink_state.received_count, sink_state.received);
+                passed = false;
+            }
+        }
+    }
+
+    // Body is passed on as sent unless decoding was asked for
+    SinkTestState sink_state = {0};
+    MinimalMultipartParserSink sink = {NULL, sink_test_on_data, NULL, &sink_state, NULL, 0, 0};
+    MinimalMultipartParserContext state = {0};
+    minimal_multipart_parser_process_sink(&state, &sink, input, input_size);
+    if (naive_find(sink_state.received, sink_state.received_count, "aGVsbG8=\r\naGk", 13) == sink_state.received_count)
+    {
+        printf("Case 'transfer encoding' (no decode) Failed\n");
+        passed = false;
+    }
+
+    if (passed)
+    {
+        printf("Case 'transfer encoding' Passed\n");
+    }
+    return passed;
+}
+
+// Feed `input` through a context with `limits`, writing one letter per event other than data (e.g. `FSCFSCM`) to `out`
+static size_t limit_events(const MinimalMultipartParserLimits *limits, const bool with_boundary, const char *input, const size_t input_size, const size_t chunk_size, char *out)
+{
+    MinimalMultipartParserContext state = {0};
+    if (with_boundary)
+    {
+        minimal_multipart_parser_init_with_boundary(&state, "AaB03x", 6);
+    }
+    state.limits = limits;
+
+    size_t data_size = 0;
+    unsigned int count = 0;
+    // Input is fed twice, nothing more may happen after a limit is hit
+    for (size_t offset = 0; offset < input_size * 2;)
+    {
+        const char *next = &input[offset % input_size];
+        const size_t remaining = input_size - offset % input_size;
+        MultipartParserEvent event;
+        if (chunk_size == 0)
+        {
+            // Per char api
+            event = minimal_multipart_parser_process(&state, *next);
+            offset++;
+        }
+        else
+        {
+            size_t consumed = 0;
+            event = minimal_multipart_parser_process_buffer(&state, next, remaining < chunk_size ? remaining : chunk_size, &consumed);
+            offset += consumed;
+        }
+
+        if (event == MultipartParserEvent_DataBufferAvailable)
+        {
+            data_size += minimal_multipart_parser_get_data_size(&state);
+        }
+        else if (event != MultipartParserEvent_None)
+        {
+            out[count++] = "-FSDCML"[event];
+        }
+
+        if (offset == input_size && !minimal_multipart_parser_is_limit_exceeded(&state))
+        {
+            // Completed without hitting a limit, so there is no point feeding it again
+            break;
+        }
+    }
+    out[count] = '\0';
+    return data_size;
+}
+
+bool test_limits(void)
+{
+    const char input[] = "preamble\r\n"
+                         "--AaB03x\r\n"
+                         "Content-Disposition: form-data; name=\"text\"\r\n"
+                         "\r\n"
+                         "text default\r\n"
+                         "--AaB03x\r\n"
+                         "Content-Disposition: form-data; name=\"file1\"; filename=\"a.txt\"\r\n"
+                         "\r\n"
+                         "Content of a.txt.\r\n"
+                         "--AaB03x--\r\n";
+    const struct
+    {
+        const char *title;
+        MinimalMultipartParserLimits limits;
+        const char *expected;
+        size_t max_data_size;
+    } cases[] = {
+        {"none", {0, 0, 0, 0}, "FSCFSCM", 29},
+        {"preamble", {5, 0, 0, 0}, "L", 0},
+        {"preamble within", {30, 0, 0, 0}, "FSCFSCM", 29},
+        {"header", {0, 60, 0, 0}, "FSCFL", 12},
+        {"header within", {0, 70, 0, 0}, "FSCFSCM", 29},
+        {"part", {0, 0, 16, 0}, "FSCFSL", 28},
+        {"part within", {0, 0, 17, 0}, "FSCFSCM", 29},
+        {"parts", {0, 0, 0, 1}, "FSCL", 12},
+        {"parts within", {0, 0, 0, 2}, "FSCFSCM", 29},
+    };
+
+    bool passed = true;
+    const size_t chunk_sizes[] = {0, 1, 7, sizeof(input) - 1};
+    for (unsigned int i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        for (unsigned int j = 0; j < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); j++)
+        {
+            for (int with_boundary = 0; with_boundary <= 1; with_boundary++)
+            {
+                char events[40];
+                const size_t data_size = limit_events(&cases[i].limits, with_boundary, input, sizeof(input) - 1, chunk_sizes[j], events);
+                const bool complete = cases[i].expected[strlen(cases[i].expected) - 1] == 'M';
+                if (strcmp(events, cases[i].expected) != 0 || data_size > cases[i].max_data_size || (complete && data_size != cases[i].max_data_size))
+                {
+                    printf("Case 'limits' (%s, %zu byte chunks%s) Failed, got '%s' with %zu data bytes\n", cases[i].title, chunk_sizes[j], with_boundary ? ", boundary given" : "", events, data_size);
+                    passed = false;
+                }
+            }
+        }
+    }
+
+    // Sink stops at the limit so the caller can drop the connection
+    SinkTestState sink_state = {0};
+    MinimalMultipartParserSink sink = {NULL, sink_test_on_data, sink_test_on_part_end, &sink_state, NULL, 0, 0};
+    const MinimalMultipartParserLimits limits = {0, 0, 0, 1};
+    MinimalMultipartParserContext state = {0};
+    state.limits = &limits;
+    const size_t consumed = minimal_multipart_parser_process_sink(&state, &sink, input, sizeof(input) - 1);
+    if (consumed >= sizeof(input) - 1 || !minimal_multipart_parser_is_limit_exceeded(&state) || strncmp(sink_state.received, "text default|", sink_state.received_count) != 0)
+    {
+        printf("Case 'limits' (sink) Failed, consumed %zu\n", consumed);
+        passed = false;
+    }
+
+    // Next request on the connection names another boundary, and the limits still apply to it
+    const char other[] = "--XyZ\r\nContent-Disposition: form-data; name=\"a\"\r\n\r\n1\r\n--XyZ\r\nContent-Disposition: form-data; name=\"b\"\r\n\r\n2\r\n--XyZ--\r\n";
+    const char other_type[] = "multipart/form-data; boundary=XyZ";
+    const bool reset = minimal_multipart_parser_reset_from_content_type(&state, other_type, sizeof(other_type) - 1);
+    unsigned int parts_found = 0;
+    for (size_t offset = 0; reset && offset < sizeof(other) - 1 && !minimal_multipart_parser_is_limit_exceeded(&state);)
+    {
+        size_t used = 0;
+        parts_found += minimal_multipart_parser_process_buffer(&state, &other[offset], sizeof(other) - 1 - offset, &used) == MultipartParserEvent_FileStreamFound ? 1 : 0;
+        offset += used;
+    }
+    if (!reset || state.limits != &limits || parts_found != 1 || !minimal_multipart_parser_is_limit_exceeded(&state))
+    {
+        printf("Case 'limits' (reset to a new boundary) Failed\n");
+        passed = false;
+    }
+
+    // Skipped part bodies count against part_bytes the same as kept ones, delimiter and released near misses included
+    const char *const bodies[] = {"a\r\nb", "a\r\nbc"};
+    const size_t body_chunk_sizes[] = {0, 1, 3, 200};
+    const MinimalMultipartParserLimits part_limits = {0, 0, 4, 0};
+    for (unsigned int body = 0; body < 2; body++)
+    {
+        char skip_input[200];
+        const int skip_size = sprintf(skip_input, "--AaB03x\r\nContent-Disposition: form-data; name=\"a\"\r\n\r\n%s\r\n--AaB03x--\r\n", bodies[body]);
+        for (unsigned int j = 0; j < sizeof(body_chunk_sizes) / sizeof(body_chunk_sizes[0]); j++)
+        {
+            for (int skip = 0; skip <= 1; skip++)
+            {
+                MinimalMultipartParserContext skip_state = {0};
+                skip_state.limits = &part_limits;
+                for (size_t offset = 0; offset < (size_t)skip_size && !minimal_multipart_parser_is_limit_exceeded(&skip_state);)
+                {
+                    MultipartParserEvent event;
+                    if (body_chunk_sizes[j] == 0)
+                    {
+                        event = minimal_multipart_parser_process(&skip_state, skip_input[offset++]);
+                    }
+                    else
+                    {
+                        const size_t remaining = (size_t)skip_size - offset;
+                        size_t used = 0;
+                        event = minimal_multipart_parser_process_buffer(&skip_state, &skip_input[offset], remaining < body_chunk_sizes[j] ? remaining : body_chunk_sizes[j], &used);
+                        offset += used;
+                    }
+                    if (event == MultipartParserEvent_FileStreamStarting && skip)
+                    {
+                        minimal_multipart_parser_skip_part(&skip_state);
+                    }
+                }
+                if (minimal_multipart_parser_is_limit_exceeded(&skip_state) != (body == 1))
+                {
+                    printf("Case 'limits' (%zu byte body%s, %zu byte chunks) Failed\n", strlen(bodies[body]), skip ? " skipped" : "", body_chunk_sizes[j]);
+                    passed = false;
+                }
+            }
+        }
+    }
+
+    if (passed)
+    {
+        printf("Case 'limits' Passed\n");
+    }
+    return passed;
+}
+
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_DIGEST
+// Append `crc32c:sha256|` in hex for the part that just completed
+static unsigned int digest_append(const MinimalMultipartParserContext *context, char *out)
+{
+    unsigned int count = sprintf(out, "%08x:", (unsigned int)minimal_multipart_parser_get_part_crc32c(context));
+    for (unsigned int i = 0; i < 32; i++)
+    {
+        count += sprintf(&out[count], "%02x", minimal_multipart_parser_get_part_sha256(context)[i]);
+    }
+    count += sprintf(&out[count], ":%u|", (unsigned int)minimal_multipart_parser_get_part_size(context));
+    return count;
+}
+
+bool test_digest(void)
+{
+    char input[600];
+    size_t input_size = 0;
+    const char *const parts[] = {"abc", "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnomnopnopq", "123456789\r\n--AaB03 not a delimiter", "",
+                                 "01234567890123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890123456789"
+                                 "012345678901234567890123456789012345678901234567890123456789012345678901234567890123456789"};
+    for (unsigned int i = 0; i < sizeof(parts) / sizeof(parts[0]); i++)
+    {
+        input_size += sprintf(&input[input_size], "--AaB03x\r\nContent-Disposition: form-data; name=\"p%u\"\r\n\r\n%s\r\n", i, parts[i]);
+    }
+    input_size += sprintf(&input[input_size], "--AaB03x--\r\n");
+
+    // Reference values from Python's hashlib and a bitwise CRC32C
+    const char expected[] = "364b3fb7:ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad:3|"
+                            "599470f2:fc6efa49c0058126cdfee45d4507753351d8e77e1cf7505b63db3831a6d46da3:59|"
+                            "78b5e0e7:eb305d8df6b3750dec8b5332db5d8f17b560fd8f603a969591ee0283010126ca:34|"
+                            "00000000:e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855:0|"
+                            "bf8c9699:295cbb667c2d2380418d4c7576c666c4f1690de2a2433f0e301bd5923377f8ed:200|";
+
+    bool passed = true;
+    const size_t chunk_sizes[] = {0, 1, 7, 64, input_size};
+    for (unsigned int i = 0; i < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); i++)
+    {
+        char received[1000];
+        unsigned int received_count = 0;
+        MinimalMultipartParserContext state = {0};
+        state.digest.enabled = true;
+        for (size_t offset = 0; offset < input_size;)
+        {
+            MultipartParserEvent event;
+            if (chunk_sizes[i] == 0)
+            {
+                // Per char api
+                event = minimal_multipart_parser_process(&state, input[offset++]);
+            }
+            else
+            {
+                const size_t remaining = input_size - offset;
+                size_t consumed = 0;
+                event = minimal_multipart_parser_process_buffer(&state, &input[offset], remaining < chunk_sizes[i] ? remaining : chunk_sizes[i], &consumed);
+                offset += consumed;
+            }
+            if (event == MultipartParserEvent_DataStreamCompleted)
+            {
+                received_count += digest_append(&state, &received[received_count]);
+            }
+        }
+
+        if (received_count != sizeof(expected) - 1 || memcmp(received, expected, received_count) != 0)
+        {
+            printf("Case 'digest' (%zu byte chunks) Failed\n", chunk_sizes[i]);
+            printf("Expected: '%s'\n", expected);
+            printf("Got: '%.*s'\n", (int)received_count, received);
+            passed = false;
+        }
+    }
+
+    if (passed)
+    {
+        printf("Case 'digest' Passed\n");
+    }
+    return passed;
+}
+#endif
+
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_STATS
+bool test_stats(void)
+{
+    const char header[] = "Content-Disposition: form-data; name=\"file\"; filename=\"a.txt\"\r\n"
+                          "Content-Type: text/plain\r\n"
+                          "\r\n";
+    char input[400];
+    const size_t input_size = sprintf(input,
+                                      "preamble line\r\n"
+                                      "--AaB03x\r\n"
+                                      "Content-Disposition: form-data; name=\"text\"\r\n"
+                                      "\r\n"
+                                      "near \r\n--AaBq miss and \r\r\n--Aa again\r\n"
+                                      "--AaB03x\r\n"
+                                      "%s"
+                                      "Content of a.txt.\r\n"
+                                      "--AaB03x--\r\n"
+                                      "epilogue",
+                                      header);
+
+    bool passed = true;
+    const size_t chunk_sizes[] = {0, 1, 7, input_size};
+    uint64_t file_bytes = 0;
+    for (unsigned int i = 0; i < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); i++)
+    {
+        MinimalMultipartParserContext state = {0};
+        for (size_t offset = 0; offset < input_size;)
+        {
+            if (chunk_sizes[i] == 0)
+            {
+                // Per char api
+                minimal_multipart_parser_process(&state, input[offset++]);
+                continue;
+            }
+            const size_t remaining = input_size - offset;
+            size_t consumed = 0;
+            minimal_multipart_parser_process_buffer(&state, &input[offset], remaining < chunk_sizes[i] ? remaining : chunk_sizes[i], &consumed);
+            offset += consumed;
+        }
+
+        // Every input byte is counted in exactly one phase, whichever api took it
+        const MinimalMultipartParserStats *stats = minimal_multipart_parser_get_stats(&state);
+        uint64_t total = 0;
+        for (unsigned int phase = 0; phase <= MultipartParserPhase_LimitExceeded; phase++)
+        {
+            total += stats->phase_bytes[phase];
+        }
+        if (i == 0)
+        {
+            file_bytes = stats->phase_bytes[MultipartParserPhase_GetFileBytes];
+
+            // Byte at a time every near miss is a partial delimiter match given up on, which the chunk api may skip without looking at
+            if (stats->boundary_restarts != 3)
+            {
+                printf("Case 'stats' (per char restarts) Failed, got %llu\n", (unsigned long long)stats->boundary_restarts);
+                passed = false;
+            }
+        }
+
+        if (total != input_size || stats->phase_bytes[MultipartParserPhase_GetFileBytes] != file_bytes || stats->phase_bytes[MultipartParserPhase_Epilogue] != 10 ||
+            stats->events[MultipartParserEvent_FileStreamFound] != 2 || stats->events[MultipartParserEvent_FileStreamStarting] != 2 ||
+            stats->events[MultipartParserEvent_DataStreamCompleted] != 2 || stats->events[MultipartParserEvent_MultipartStreamCompleted] != 1 ||
+            stats->events[MultipartParserEvent_None] != 0 || stats->max_header_size != sizeof(header) - 1)
+        {
+            printf("Case 'stats' (%zu byte chunks) Failed\n", chunk_sizes[i]);
+            printf("Bytes %llu of %zu, file bytes %llu, restarts %llu, max header %u\n", (unsigned long long)total, input_size,
+                   (unsigned long long)stats->phase_bytes[MultipartParserPhase_GetFileBytes], (unsigned long long)stats->boundary_restarts, stats->max_header_size);
+            passed = false;
+        }
+    }
+
+    if (passed)
+    {
+        printf("Case 'stats' Passed\n");
+    }
+    return passed;
+}
+#endif
+
+bool test_filter(void)
+{
+    char attachment[3000];
+    for (unsigned int i = 0; i < sizeof(attachment); i++)
+    {
+        // Mostly delimiter chars, so the skip has plenty of near misses to get through
+        attachment[i] = "\r\n--AaB03y"[prng() % 10];
+    }
+
+    char input[4000];
+    size_t input_size = 0;
+    input_size += sprintf(&input[input_size], "--AaB03x\r\nContent-Disposition: form-data; name=\"text\"\r\n\r\ntext default\r\n");
+    input_size += sprintf(&input[input_size], "--AaB03x\r\nContent-Disposition: form-data; name=\"photo\"; filename=\"holiday.JPG\"\r\n\r\n");
+    memcpy(&input[input_size], attachment, sizeof(attachment));
+    input_size += sizeof(attachment);
+    input_size += sprintf(&input[input_size], "\r\n--AaB03x\r\nContent-Disposition: form-data; name=\"firmware\"; filename=\"fw-v2.bin\"\r\n\r\nfirmware image\r\n"
+                                              "--AaB03x\r\nContent-Disposition: form-data; name=\"notes\"; filename=\"notes.txt\"\r\n\r\nnotes\r\n"
+                                              "--AaB03x--\r\n");
+
+    const char *const names[] = {"firmware", "text"};
+    const char *const globs[] = {"*.txt", "fw-??.bin", "*.jpg"};
+    const struct
+    {
+        MinimalMultipartParserFilter filter;
+        const char *expected;
+    } cases[] = {
+        {{names, 1, NULL, 0}, "firmware image|"},
+        {{names, 2, NULL, 0}, "text default|firmware image|"},
+        {{NULL, 0, globs, 1}, "notes|"},
+        {{NULL, 0, &globs[1], 2}, "firmware image|"}, // Globs are case sensitive, `holiday.JPG` is not `*.jpg`
+        {{&names[1], 1, globs, 1}, "text default|notes|"},
+        {{NULL, 0, NULL, 0}, ""},
+    };
+
+    bool passed = true;
+    const size_t chunk_sizes[] = {0, 1, 7, 64, input_size};
+    for (unsigned int c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+    {
+        for (unsigned int i = 0; i < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); i++)
+        {
+            char received[4000];
+            unsigned int received_count = 0;
+            MinimalMultipartParserContext state = {0};
+            for (size_t offset = 0; offset < input_size;)
+            {
+                MultipartParserEvent event;
+                if (chunk_sizes[i] == 0)
+                {
+                    // Per char api
+                    event = minimal_multipart_parser_process(&state, input[offset++]);
+                }
+                else
+                {
+                    const size_t remaining = input_size - offset;
+                    size_t consumed = 0;
+                    event = minimal_multipart_parser_process_buffer(&state, &input[offset], remaining < chunk_sizes[i] ? remaining : chunk_sizes[i], &consumed);
+                    offset += consumed;
+                }
+
+                if (event == MultipartParserEvent_FileStreamStarting && !minimal_multipart_parser_filter_match(&cases[c].filter, &state))
+                {
+                    minimal_multipart_parser_skip_part(&state);
+                }
+                else if (event == MultipartParserEvent_DataBufferAvailable)
+                {
+                    memcpy(&received[received_count], minimal_multipart_parser_get_data_buffer(&state), minimal_multipart_parser_get_data_size(&state));
+                    received_count += minimal_multipart_parser_get_data_size(&state);
+                }
+                else if (event == MultipartParserEvent_DataStreamCompleted)
+                {
+                    received[received_count++] = '|';
+                }
+            }
+
+            // Skipped parts are not counted as completed
+            unsigned int kept = 0;
+            for (const char *next = cases[c].expected; *next != '\0'; next++)
+            {
+                kept += (*next == '|') ? 1 : 0;
+            }
+            if (received_count != strlen(cases[c].expected) || memcmp(received, cases[c].expected, received_count) != 0 || !minimal_multipart_parser_is_multipart_completed(&state) ||
+                minimal_multipart_parser_get_parts_completed(&state) != kept)
+            {
+                printf("Case 'filter' (case %u, %zu byte chunks) Failed\n", c, chunk_sizes[i]);
+                printf("Expected: '%s'\n", cases[c].expected);
+                printf("Got: '%.*s'\n", (int)received_count, received);
+                passed = false;
+            }
+        }
+
+        // Sink api applies the filter itself, skipped parts get no callbacks at all
+        SinkTestState sink_state = {0};
+        MinimalMultipartParserSink sink = {sink_test_on_part_begin, sink_test_on_data, sink_test_on_part_end, &sink_state, NULL, 0, 0};
+        sink.filter = &cases[c].filter;
+        MinimalMultipartParserContext state = {0};
+        minimal_multipart_parser_process_sink(&state, &sink, input, input_size);
+        char expected[200] = "";
+        size_t expected_count = 0;
+        const char *const part_names[] = {"text", "firmware", "notes"};
+        const char *const part_data[] = {"text default|", "firmware image|", "notes|"};
+        for (unsigned int j = 0; j < 3; j++)
+        {
+            if (strstr(cases[c].expected, part_data[j]))
+            {
+                expected_count += sprintf(&expected[expected_count], "<%s>%s", part_names[j], part_data[j]);
+            }
+        }
+        if (sink_state.received_count != expected_count || memcmp(sink_state.received, expected, expected_count) != 0)
+        {
+            printf("Case 'filter' (case %u, sink) Failed, got '%.*s'\n", c, (int)sink_state.received_count, sink_state.received);
+            passed = false;
+        }
+    }
+
+    // Filtered out parts still count against the parts limit, so a filter cannot be used to send any number of them
+    static char junk[70000];
+    const MinimalMultipartParserLimits limits = {0, 0, 0, 10};
+    const MinimalMultipartParserFilter wanted = {(const char *const[]){"wanted"}, 1, NULL, 0};
+    const unsigned int junk_parts[] = {1000, 9};
+    for (unsigned int j = 0; j < sizeof(junk_parts) / sizeof(junk_parts[0]); j++)
+    {
+        size_t junk_size = 0;
+        for (unsigned int i = 0; i < junk_parts[j]; i++)
+        {
+            junk_size += sprintf(&junk[junk_size], "--AaB03x\r\nContent-Disposition: form-data; name=\"junk%u\"\r\n\r\nx\r\n", i);
+        }
+        junk_size += sprintf(&junk[junk_size], "--AaB03x\r\nContent-Disposition: form-data; name=\"wanted\"\r\n\r\nyes\r\n--AaB03x--\r\n");
+
+        SinkTestState sink_state = {0};
+        MinimalMultipartParserSink sink = {sink_test_on_part_begin, sink_test_on_data, sink_test_on_part_end, &sink_state, NULL, 0, 0};
+        sink.filter = &wanted;
+        MinimalMultipartParserContext state = {0};
+        state.limits = &limits;
+        const size_t consumed = minimal_multipart_parser_process_sink(&state, &sink, junk, junk_size);
+        const bool over = junk_parts[j] + 1 > limits.parts;
+        if (minimal_multipart_parser_is_limit_exceeded(&state) != over || (consumed < junk_size) != over ||
+            (!over && strcmp(sink_state.received, "<wanted>yes|") != 0) || minimal_multipart_parser_get_parts_completed(&state) != (over ? 0 : 1))
+        {
+            printf("Case 'filter' (%u junk parts with a parts limit) Failed, consumed %zu of %zu\n", junk_parts[j], consumed, junk_size);
+            passed = false;
+        }
+    }
+
+    if (passed)
+    {
+        printf("Case 'filter' Passed\n");
+    }
+    return passed;
+}
+
+// Parses `input` up to `split`, saves a checkpoint there and carries on in a new context restored from it
+static unsigned int checkpoint_run(const char *input, const size_t input_size, const size_t split, const size_t chunk_size, const bool with_boundary, char *out)
+{
+    MinimalMultipartParserContext contexts[2] = {{0}, {0}};
+    for (unsigned int i = 0; i < 2; i++)
+    {
+        if (with_boundary)
+        {
+            minimal_multipart_parser_init_with_boundary(&contexts[i], "AaB03x", 6);
+        }
+    }
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_DIGEST
+    // Only the first context has it set, the restored one picks it up from the checkpoint
+    contexts[0].digest.enabled = true;
+#endif
+
+    unsigned int count = 0;
+    MinimalMultipartParserContext *state = &contexts[0];
+    for (unsigned long long offset = 0; offset < input_size;)
+    {
+        if (offset >= split && state == &contexts[0])
+        {
+            unsigned char blob[MINIMAL_MULTIPART_PARSER_CHECKPOINT_MAX_SIZE];
+            const size_t blob_size = minimal_multipart_parser_checkpoint_save(state, NULL, offset, blob, sizeof(blob));
+            state = &contexts[1];
+            if (blob_size == 0 || !minimal_multipart_parser_checkpoint_restore(state, NULL, blob, blob_size, &offset))
+            {
+                return 0;
+            }
+        }
+
+        MultipartParserEvent event;
+        if (chunk_size == 0)
+        {
+            // Per char api
+            event = minimal_multipart_parser_process(state, input[offset++]);
+        }
+        else
+        {
+            // Chunks are cut at the split, as a dropped connection would
+            const size_t end = (offset < split && split - offset < chunk_size) ? split : offset + chunk_size;
+            size_t consumed = 0;
+            event = minimal_multipart_parser_process_buffer(state, &input[offset], (end < input_size ? end : input_size) - offset, &consumed);
+            offset += consumed;
+        }
+
+        if (event == MultipartParserEvent_DataBufferAvailable)
+        {
+            memcpy(&out[count], minimal_multipart_parser_get_data_buffer(state), minimal_multipart_parser_get_data_size(state));
+            count += minimal_multipart_parser_get_data_size(state);
+        }
+        else if (event == MultipartParserEvent_FileStreamFound)
+        {
+            count += sprintf(&out[count], "<%s>", minimal_multipart_parser_get_part_name(state));
+        }
+        else if (event == MultipartParserEvent_DataStreamCompleted)
+        {
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_DIGEST
+            count += digest_append(state, &out[count]);
+#else
+            out[count++] = '|';
+#endif
+        }
+    }
+    return count;
+}
+
+// Overwrite one byte of a saved blob and fix up its FNV-1a hash, as a forged blob would
+static void checkpoint_forge(unsigned char *blob, const size_t blob_size, const size_t offset, const unsigned char value)
+{
+    blob[offset] = value;
+    unsigned long hash = 2166136261ul;
+    for (size_t i = 0; i + 4 < blob_size; i++)
+    {
+        hash = ((hash ^ blob[i]) * 16777619ul) & 0xFFFFFFFFul;
+    }
+    for (unsigned int i = 0; i < 4; i++)
+    {
+        blob[blob_size - 4 + i] = (unsigned char)(hash >> (8 * i));
+    }
+}
+
+bool test_checkpoint(void)
+{
+    const char input[] = "preamble\r\n"
+                         "--AaB03x\r\n"
+                         "Content-Disposition: form-data; name=\"text\"\r\n"
+                         "\r\n"
+                         "text default\r\n--AaB03 not a delimiter\r\n"
+                         "--AaB03x\r\n"
+                         "Content-Disposition: form-data; name=\"file1\"; filename=\"a.txt\"\r\n"
+                         "Content-Type: text/plain\r\n"
+                         "\r\n"
+                         "Content of a.txt. Long enough to take more than one SHA-256 block when digests are enabled, "
+                         "which they are in some of the builds that run this test.\r\n"
+                         "--AaB03x--\r\n"
+                         "epilogue";
+    const size_t input_size = sizeof(input) - 1;
+
+    bool passed = true;
+    const size_t chunk_sizes[] = {0, 1, 7, 64};
+    for (unsigned int with_boundary = 0; with_boundary < 2; with_boundary++)
+    {
+        for (unsigned int i = 0; i < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); i++)
+        {
+            // Uninterrupted run to compare against
+            char expected[1000];
+            const unsigned int expected_count = checkpoint_run(input, input_size, input_size, chunk_sizes[i], with_boundary, expected);
+            for (size_t split = 0; split < input_size; split++)
+            {
+                char received[1000];
+                const unsigned int received_count = checkpoint_run(input, input_size, split, chunk_sizes[i], with_boundary, received);
+                if (received_count != expected_count || memcmp(received, expected, received_count) != 0)
+                {
+                    printf("Case 'checkpoint' (%s, %zu byte chunks, split at %zu) Failed\n", with_boundary ? "with boundary" : "found boundary", chunk_sizes[i], split);
+                    printf("Expected: '%.*s'\n", (int)expected_count, expected);
+                    printf("Got: '%.*s'\n", (int)received_count, received);
+                    passed = false;
+                }
+            }
+        }
+    }
+
+    // Sink api, flushed before saving so a half decoded base64 group is carried over
+    const char encoded[] = "--AaB03x\r\n"
+                           "Content-Disposition: form-data; name=\"b\"\r\n"
+                           "Content-Transfer-Encoding: base64\r\n"
+                           "\r\n"
+                           "SGVsbG8sIHdvcmxkIQ==\r\n"
+                           "--AaB03x--\r\n";
+    for (size_t split = 0; split < sizeof(encoded) - 1; split++)
+    {
+        SinkTestState sink_state = {0};
+        MinimalMultipartParserSink sink = {sink_test_on_part_begin, sink_test_on_data, sink_test_on_part_end, &sink_state, NULL, 0, 0, true};
+        MinimalMultipartParserContext state = {0};
+        size_t offset = minimal_multipart_parser_process_sink(&state, &sink, encoded, split);
+        minimal_multipart_parser_sink_flush(&sink);
+
+        unsigned char blob[MINIMAL_MULTIPART_PARSER_CHECKPOINT_MAX_SIZE];
+        const size_t blob_size = minimal_multipart_parser_checkpoint_save(&state, &sink, offset, blob, sizeof(blob));
+        MinimalMultipartParserContext restored = {0};
+        MinimalMultipartParserSink restored_sink = {sink_test_on_part_begin, sink_test_on_data, sink_test_on_part_end, &sink_state, NULL, 0, 0, true};
+        unsigned long long restored_offset = 0;
+        if (!minimal_multipart_parser_checkpoint_restore(&restored, &restored_sink, blob, blob_size, &restored_offset) || restored_offset != offset)
+        {
+            printf("Case 'checkpoint' (sink, split at %zu) Failed to restore\n", split);
+            passed = false;
+            continue;
+        }
+        minimal_multipart_parser_process_sink(&restored, &restored_sink, &encoded[offset], sizeof(encoded) - 1 - offset);
+        if (sink_state.received_count != 17 || memcmp(sink_state.received, "<b>Hello, world!|", 17) != 0)
+        {
+            printf("Case 'checkpoint' (sink, split at %zu) Failed, got '%.*s'\n", split, (int)sink_state.received_count, sink_state.received);
+            passed = false;
+        }
+    }
+
+    // Damaged, truncated or short blobs are refused and leave the context alone
+    MinimalMultipartParserContext state = {0};
+    minimal_multipart_parser_process(&state, '-');
+    unsigned char blob[MINIMAL_MULTIPART_PARSER_CHECKPOINT_MAX_SIZE];
+    const size_t blob_size = minimal_multipart_parser_checkpoint_save(&state, NULL, 1, blob, sizeof(blob));
+    const bool too_small = minimal_multipart_parser_checkpoint_save(&state, NULL, 1, blob, blob_size - 1) == 0;
+    minimal_multipart_parser_checkpoint_save(&state, NULL, 1, blob, sizeof(blob));
+    MinimalMultipartParserContext untouched = {0};
+    minimal_multipart_parser_init_with_boundary(&untouched, "AaB03x", 6);
+    const MinimalMultipartParserContext before = untouched;
+    blob[blob_size / 2] ^= 1;
+    if (!too_small || minimal_multipart_parser_checkpoint_restore(&untouched, NULL, blob, blob_size, NULL) ||
+        minimal_multipart_parser_checkpoint_restore(&untouched, NULL, blob, blob_size - 1, NULL) || memcmp(&before, &untouched, sizeof(before)) != 0)
+    {
+        printf("Case 'checkpoint' (bad blob) Failed\n");
+        passed = false;
+    }
+
+    // Every truncation of a good blob is refused
+    MinimalMultipartParserContext mid_header = {0};
+    minimal_multipart_parser_init_with_boundary(&mid_header, "AaB03x", 6);
+    const char header_start[] = "--AaB03x\r\nContent-Disp";
+    for (size_t i = 0; i < sizeof(header_start) - 1; i++)
+    {
+        minimal_multipart_parser_process(&mid_header, header_start[i]);
+    }
+    unsigned char good[MINIMAL_MULTIPART_PARSER_CHECKPOINT_MAX_SIZE];
+    const size_t good_size = minimal_multipart_parser_checkpoint_save(&mid_header, NULL, 0, good, sizeof(good));
+    for (size_t size = 0; size < good_size; size++)
+    {
+        MinimalMultipartParserContext target = {0};
+        if (minimal_multipart_parser_checkpoint_restore(&target, NULL, good, size, NULL))
+        {
+            printf("Case 'checkpoint' (truncated to %zu bytes) Failed\n", size);
+            passed = false;
+        }
+    }
+
+    // Blobs that pass the hash but hold values past what the parser could have saved. Offsets are those of the version 2 layout
+    const struct
+    {
+        const char *title;
+        size_t offset;
+        unsigned char value;
+        bool accepted;
+    } forged[] = {
+        {"unchanged", 11, 12, true},          // Name size of `content-disp`, checks the forging itself
+        {"phase", 6, 200, false},             // Past MultipartParserPhase_LimitExceeded
+        {"header state", 9, 99, false},       // Past MultipartParserHeaderState_EncodingValue
+        {"candidates", 10, 0x80, false},      // Only 3 header names to match
+        {"name size", 11, 200, false},        // Past the end of `content-disposition`
+        {"field", 12, 9, false},              // No such part info field
+        {"field size", 13, 200, false},       // Longer than any part info field
+        {"boundary not built", 5, 0, false},  // Part headers without the delimiter's skip table
+    };
+    for (unsigned int i = 0; i < sizeof(forged) / sizeof(forged[0]); i++)
+    {
+        unsigned char bad[MINIMAL_MULTIPART_PARSER_CHECKPOINT_MAX_SIZE];
+        memcpy(bad, good, good_size);
+        checkpoint_forge(bad, good_size, forged[i].offset, forged[i].value);
+        MinimalMultipartParserContext target = {0};
+        if (minimal_multipart_parser_checkpoint_restore(&target, NULL, bad, good_size, NULL) != forged[i].accepted)
+        {
+            printf("Case 'checkpoint' (forged %s) Failed\n", forged[i].title);
+            passed = false;
+        }
+    }
+
+    // Searching for the first delimiter with no skip table would never move on through the chunk api
+    MinimalMultipartParserContext seeking = {0};
+    minimal_multipart_parser_init_with_boundary(&seeking, "AaB03x", 6);
+    unsigned char seek_blob[MINIMAL_MULTIPART_PARSER_CHECKPOINT_MAX_SIZE];
+    const size_t seek_size = minimal_multipart_parser_checkpoint_save(&seeking, NULL, 0, seek_blob, sizeof(seek_blob));
+    checkpoint_forge(seek_blob, seek_size, 5, seek_blob[5] & ~1u);
+    MinimalMultipartParserContext target = {0};
+    if (minimal_multipart_parser_checkpoint_restore(&target, NULL, seek_blob, seek_size, NULL))
+    {
+        printf("Case 'checkpoint' (seek without skip table) Failed\n");
+        passed = false;
+    }
+
+    // Sink decode state past what either transfer encoding keeps
+    SinkTestState sink_state = {0};
+    MinimalMultipartParserSink sink = {sink_test_on_part_begin, sink_test_on_data, sink_test_on_part_end, &sink_state, NULL, 0, 0, true};
+    unsigned char sink_blob[MINIMAL_MULTIPART_PARSER_CHECKPOINT_MAX_SIZE];
+    const size_t sink_size = minimal_multipart_parser_checkpoint_save(&seeking, &sink, 0, sink_blob, sizeof(sink_blob));
+    checkpoint_forge(sink_blob, sink_size, sink_size - 9, 4);
+    if (minimal_multipart_parser_checkpoint_restore(&target, &sink, sink_blob, sink_size, NULL))
+    {
+        printf("Case 'checkpoint' (forged sink decode state) Failed\n");
+        passed = false;
+    }
+
+    if (passed)
+    {
+        printf("Case 'checkpoint' Passed\n");
+    }
+    return passed;
+}
+
+int main(int argc, char **argv)
+{
+    printf("Testing Minimal Multipart Form Data Parser\n");
+    printf("GCC Version: v%s\n", __VERSION__);
+    printf("Context size: %zu bytes\n", sizeof(MinimalMultipartParserContext));
+
+    if (!test_case1())
+    {
+        return 1;
+    }
+
+    if (!test_case2())
+    {
+        return 1;
+    }
+
+    if (!test_case3())
+    {
+        return 1;
+    }
+
+    if (!test_case4())
+    {
+        return 1;
+    }
+
+    if (!test_case5())
+    {
+        return 1;
+    }
+
+    if (!test_case6())
+    {
+        return 1;
+    }
+
+    if (!test_case7())
+    {
+        return 1;
+    }
+
+    if (!test_case8())
+    {
+        return 1;
+    }
+
+    if (!test_zero_copy_slices())
+    {
+        return 1;
+    }
+
+    if (!test_multipart_iteration())
+    {
+        return 1;
+    }
+
+    if (!test_part_headers())
+    {
+        return 1;
+    }
+
+    if (!test_init_from_content_type())
+    {
+        return 1;
+    }
+
+    if (!test_boundary_fuzz())
+    {
+        return 1;
+    }
+
+    if (!test_sink())
+    {
+        return 1;
+    }
+
+    if (!test_sink_pause())
+    {
+        return 1;
+    }
+
+    if (!test_find_delimiter())
+    {
+        return 1;
+    }
+
+    if (!test_reset())
+    {
+        return 1;
+    }
+
+    if (!test_transfer_encoding())
+    {
+        return 1;
+    }
+
+    if (!test_limits())
+    {
+        return 1;
+    }
+
+    if (!test_checkpoint())
+    {
+        return 1;
+    }
+
+    if (!test_filter())
+    {
+        return 1;
+    }
+
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_DIGEST
+    if (!test_digest())
+    {
+        return 1;
+    }
+#endif
+
+#ifdef MINIMAL_MULTIPART_PARSER_ENABLE_STATS
+    if (!test_stats())
+    {
+        return 1;
+    }
+#endif
+
     printf("PASSED\n");
     return 0;
 }
@@ -0,0 +1,301 @@
+//
+// test_compact.c
+//
+// Copyright (c) 2024 Brian Khuu
+// MIT licensed
+//
+
+// Tests for the compact context layout and context pool. Built with MINIMAL_MULTIPART_PARSER_COMPACT_CONTEXT
+// defined for both this file and the library, see `make test_compact`.
+
+#include "minimal_multipart_parser.h"
+#include "test_support.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef MINIMAL_MULTIPART_PARSER_COMPACT_CONTEXT
+#error "Build with -DMINIMAL_MULTIPART_PARSER_COMPACT_CONTEXT"
+#endif
+
+bool test_compact_size(void)
+{
+    // Per connection state must be a few dozen bytes, with the boundary and part headers kept elsewhere
+    const size_t size = sizeof(MinimalMultipartParserContext);
+    if (size > 64)
+    {
+        printf("Case 'compact size' Failed, context is %zu bytes\n", size);
+        return false;
+    }
+    printf("Case 'compact size' Passed\n");
+    return true;
+}
+
+bool test_compact_fuzz(void)
+{
+    // Random parts built mostly out of the delimiter's own chars, as in test.c, split by the naive search
+    const char delimiter[] = "\r\n--a-b";
+    const char alphabet[] = "\r\n--a-bx";
+    MinimalMultipartParserBoundary boundary;
+    if (!minimal_multipart_parser_boundary_init(&boundary, "a-b", 3))
+    {
+        printf("Case 'compact fuzz' (boundary init) Failed\n");
+        return false;
+    }
+
+    bool passed = true;
+    for (unsigned int round = 0; round < 2000 && passed; round++)
+    {
+        char input[600];
+        char expected[600];
+        size_t input_size = 0;
+        unsigned int expected_count = 0;
+        const unsigned int part_count = 1 + prng() % 3;
+        memcpy(&input[input_size], "--a-b\r\n\r\n", 9);
+        input_size += 9;
+        for (unsigned int part = 0; part < part_count; part++)
+        {
+            const size_t part_start = input_size;
+            const unsigned int part_size = prng() % 150;
+            for (unsigned int i = 0; i < part_size; i++)
+            {
+                input[input_size++] = alphabet[prng() % (sizeof(alphabet) - 1)];
+                if (naive_find(&input[part_start], input_size - part_start, delimiter, sizeof(delimiter) - 1) < input_size - part_start)
+                {
+                    // Generated a real delimiter, drop its last byte
+                    input_size--;
+                }
+            }
+            memcpy(&expected[expected_count], &input[part_start], input_size - part_start);
+            expected_count += input_size - part_start;
+            expected[expected_count++] = '|';
+
+            const char *next = (part + 1 < part_count) ? "\r\n--a-b\r\n\r\n" : "\r\n--a-b--\r\n";
+            memcpy(&input[input_size], next, strlen(next));
+            input_size += strlen(next);
+        }
+        expected[expected_count] = '\0';
+
+        const size_t chunk_sizes[] = {1, 1 + prng() % 8, 1 + prng() % 64, input_size};
+        for (unsigned int i = 0; i < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); i++)
+        {
+            MinimalMultipartParserContext context;
+            CollectedParts collected = {0};
+            minimal_multipart_parser_init_shared(&context, &boundary, NULL);
+            test_collect_parts(&context, COLLECT_SINK, input, input_size, chunk_sizes[i], &collected);
+            if (collected.count != expected_count || memcmp(collected.out, expected, expected_count) != 0 || !minimal_multipart_parser_is_multipart_completed(&context))
+            {
+                printf("Case 'compact fuzz' (round %u, %zu byte chunks) Failed\n", round, chunk_sizes[i]);
+                printf("Expected: '%s'\n", expected);
+                printf("Got: '%s'\n", collected.out);
+                passed = false;
+                break;
+            }
+        }
+    }
+
+    if (passed)
+    {
+        printf("Case 'compact fuzz' Passed\n");
+    }
+    return passed;
+}
+
+bool test_pool(void)
+{
+    const char input[] = "preamble\r\n"
+                         "--AaB03x\r\n"
+                         "Content-Disposition: form-data; name=\"text\"\r\n"
+                         "\r\n"
+                         "text default\r\n"
+                         "--AaB03x\r\n"
+                         "Content-Disposition: form-data; name=\"file1\"; filename=\"a.txt\"\r\n"
+                         "\r\n"
+                         "Content of a.txt.\r\n"
+                         "--AaB03x--\r\n";
+    const char content_type[] = "multipart/form-data; boundary=AaB03x";
+    const char other_content_type[] = "multipart/form-data; boundary=\"other\"";
+    const char third_content_type[] = "multipart/form-data; boundary=third";
+
+    static MinimalMultipartParserPoolSlot slots[3];
+    static MinimalMultipartParserPoolBoundary boundaries[2];
+    MinimalMultipartParserPool pool;
+    minimal_multipart_parser_pool_init(&pool, slots, 3, boundaries, 2);
+
+    bool passed = true;
+
+    // Uploads with the same boundary share its descriptor
+    MinimalMultipartParserPartInfo part;
+    MinimalMultipartParserContext *first = minimal_multipart_parser_pool_acquire(&pool, content_type, strlen(content_type), &part);
+    MinimalMultipartParserContext *second = minimal_multipart_parser_pool_acquire(&pool, content_type, strlen(content_type), NULL);
+    if (!first || !second || first == second || first->boundary != second->boundary || boundaries[0].references != 2)
+    {
+        printf("Case 'pool' (shared descriptor) Failed\n");
+        passed = false;
+    }
+
+    // Distinct boundary takes the other descriptor, after which there are none left for a third boundary
+    MinimalMultipartParserContext *other = minimal_multipart_parser_pool_acquire(&pool, other_content_type, strlen(other_content_type), NULL);
+    if (!other || other->boundary == first->boundary || strcmp(minimal_multipart_parser_get_boundary(other), "other") != 0)
+    {
+        printf("Case 'pool' (second descriptor) Failed\n");
+        passed = false;
+    }
+    if (minimal_multipart_parser_pool_acquire(&pool, content_type, strlen(content_type), NULL) != NULL)
+    {
+        printf("Case 'pool' (out of contexts) Failed\n");
+        passed = false;
+    }
+    if (minimal_multipart_parser_pool_acquire(&pool, "multipart/form-data", strlen("multipart/form-data"), NULL) != NULL)
+    {
+        printf("Case 'pool' (no boundary) Failed\n");
+        passed = false;
+    }
+
+    // Contexts parse independently of each other, and only the one given storage keeps the part headers
+    CollectedParts collected_first = {0};
+    CollectedParts collected_second = {0};
+    test_collect_parts(first, COLLECT_SINK, input, 40, 7, &collected_first);
+    test_collect_parts(second, COLLECT_SINK, input, sizeof(input) - 1, 5, &collected_second);
+    test_collect_parts(first, COLLECT_SINK, &input[40], sizeof(input) - 1 - 40, 3, &collected_first);
+    if (strcmp(collected_first.out, "text default|Content of a.txt.|") != 0 || strcmp(collected_second.out, collected_first.out) != 0 ||
+        strcmp(collected_first.names, "text|file1|") != 0 || strcmp(collected_second.names, "||") != 0 || strcmp(part.filename, "a.txt") != 0)
+    {
+        printf("Case 'pool' (parse) Failed\n");
+        printf("Got: '%s' '%s' '%s' '%s'\n", collected_first.out, collected_second.out, collected_first.names, collected_second.names);
+        passed = false;
+    }
+
+    // Next request on the same connection keeps the descriptor and part info storage
+    CollectedParts collected_again = {0};
+    const MinimalMultipartParserBoundary *shared = first->boundary;
+    minimal_multipart_parser_reset(first);
+    test_collect_parts(first, COLLECT_SINK, input, sizeof(input) - 1, 11, &collected_again);
+    if (first->boundary != shared || strcmp(collected_again.out, collected_first.out) != 0 || strcmp(collected_again.names, "text|file1|") != 0)
+    {
+        printf("Case 'pool' (reset) Failed\n");
+        passed = false;
+    }
+
+    // Once the last upload on a boundary is done its descriptor can be reused for a new one
+    minimal_multipart_parser_pool_release(&pool, other);
+    MinimalMultipartParserContext *third = minimal_multipart_parser_pool_acquire(&pool, third_content_type, strlen(third_content_type), NULL);
+    if (!third || third != other || boundaries[1].references != 1 || strcmp(minimal_multipart_parser_get_boundary(third), "third") != 0)
+    {
+        printf("Case 'pool' (release and reuse) Failed\n");
+        passed = false;
+    }
+
+    minimal_multipart_parser_pool_release(&pool, first);
+    minimal_multipart_parser_pool_release(&pool, second);
+    minimal_multipart_parser_pool_release(&pool, third);
+    if (boundaries[0].references != 0 || boundaries[1].references != 0)
+    {
+        printf("Case 'pool' (all released) Failed\n");
+        passed = false;
+    }
+
+    // Limits set on the pool apply to every context it hands out
+    const MinimalMultipartParserLimits limits = {0, 0, 0, 1};
+    pool.limits = &limits;
+    CollectedParts collected_limited = {0};
+    MinimalMultipartParserContext *limited = minimal_multipart_parser_pool_acquire(&pool, content_type, strlen(content_type), NULL);
+    test_collect_parts(limited, COLLECT_SINK, input, sizeof(input) - 1, 9, &collected_limited);
+    if (!minimal_multipart_parser_is_limit_exceeded(limited) || strcmp(collected_limited.out, "text default|") != 0)
+    {
+        printf("Case 'pool' (limits) Failed, got '%s'\n", collected_limited.out);
+        passed = false;
+    }
+    minimal_multipart_parser_pool_release(&pool, limited);
+
+    if (passed)
+    {
+        printf("Case 'pool' Passed\n");
+    }
+    return passed;
+}
+
+bool test_compact_checkpoint(void)
+{
+    const char input[] = "--AaB03x\r\n"
+                         "Content-Disposition: form-data; name=\"text\"\r\n"
+                         "\r\n"
+                         "text default\r\n"
+                         "--AaB03x\r\n"
+                         "Content-Disposition: form-data; name=\"file1\"; filename=\"a.txt\"\r\n"
+                         "\r\n"
+                         "Content of a.txt.\r\n"
+                         "--AaB03x--\r\n";
+    MinimalMultipartParserBoundary boundary;
+    MinimalMultipartParserBoundary other;
+    minimal_multipart_parser_boundary_init(&boundary, "AaB03x", 6);
+    minimal_multipart_parser_boundary_init(&other, "AaB03y", 6);
+
+    bool passed = true;
+    for (size_t split = 0; split < sizeof(input) - 1 && passed; split++)
+    {
+        // Each context has its own part storage, only the boundary is shared
+        MinimalMultipartParserPartInfo parts[2];
+        MinimalMultipartParserContext context;
+        CollectedParts collected = {0};
+        minimal_multipart_parser_init_shared(&context, &boundary, &parts[0]);
+        test_collect_parts(&context, COLLECT_SINK, input, split, 1, &collected);
+
+        unsigned char blob[MINIMAL_MULTIPART_PARSER_CHECKPOINT_MAX_SIZE];
+        const size_t blob_size = minimal_multipart_parser_checkpoint_save(&context, NULL, split, blob, sizeof(blob));
+        MinimalMultipartParserContext restored;
+        unsigned long long offset = 0;
+        minimal_multipart_parser_init_shared(&restored, &other, &parts[1]);
+        const bool wrong_boundary_refused = !minimal_multipart_parser_checkpoint_restore(&restored, NULL, blob, blob_size, &offset);
+        minimal_multipart_parser_init_shared(&restored, &boundary, &parts[1]);
+        if (!wrong_boundary_refused || !minimal_multipart_parser_checkpoint_restore(&restored, NULL, blob, blob_size, &offset) || offset != split)
+        {
+            printf("Case 'compact checkpoint' (split at %zu) Failed to restore\n", split);
+            passed = false;
+            break;
+        }
+        test_collect_parts(&restored, COLLECT_SINK, &input[offset], sizeof(input) - 1 - offset, 5, &collected);
+        if (strcmp(collected.out, "text default|Content of a.txt.|") != 0 || strcmp(minimal_multipart_parser_get_part_filename(&restored), "a.txt") != 0 ||
+            minimal_multipart_parser_get_parts_completed(&restored) != 2)
+        {
+            printf("Case 'compact checkpoint' (split at %zu) Failed, got '%s'\n", split, collected.out);
+            passed = false;
+        }
+    }
+
+    if (passed)
+    {
+        printf("Case 'compact checkpoint' Passed\n");
+    }
+    return passed;
+}
+
+int main(int argc, char **argv)
+{
+    printf("Testing Minimal Multipart Form Data Parser (compact context)\n");
+    printf("GCC Version: v%s\n", __VERSION__);
+    printf("Context size: %zu bytes\n", sizeof(MinimalMultipartParserContext));
+
+    if (!test_compact_size())
+    {
+        return 1;
+    }
+
+    if (!test_compact_fuzz())
+    {
+        return 1;
+    }
+
+    if (!test_pool())
+    {
+        return 1;
+    }
+
+    if (!test_compact_checkpoint())
+    {
+        return 1;
+    }
+
+    printf("PASSED\n");
+    return 0;
+}
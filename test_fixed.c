@@ -0,0 +1,161 @@
+//
+// test_fixed.c
+//
+// Copyright (c) 2024 Brian Khuu
+// MIT licensed
+//
+
+// Tests for the build time boundary. Built with MINIMAL_MULTIPART_PARSER_FIXED_BOUNDARY="AaB03x" defined for both this
+// file and the library, see `make test_fixed`.
+
+#include "minimal_multipart_parser.h"
+#include "test_support.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef MINIMAL_MULTIPART_PARSER_FIXED_BOUNDARY
+#error "Build with -DMINIMAL_MULTIPART_PARSER_FIXED_BOUNDARY='\"AaB03x\"'"
+#endif
+
+// Body with a preamble (which may hold a line that looks like some other boundary) and two parts, each part's data written
+// to `expected` followed by '|'
+static size_t build_body(char *out, char *expected, size_t *expected_size, const bool preamble)
+{
+    size_t size = 0;
+    *expected_size = 0;
+    if (preamble)
+    {
+        size += sprintf(&out[size], "This is the preamble\r\n--OtherBoundary\r\n\r\n");
+    }
+    for (unsigned int part = 0; part < 2; part++)
+    {
+        size += sprintf(&out[size], "--AaB03x\r\nContent-Disposition: form-data; name=\"part%u\"\r\n\r\n", part);
+        const unsigned int data_size = prng() % 300;
+        for (unsigned int i = 0; i < data_size; i++)
+        {
+            // Delimiter near misses as well as random bytes
+            const char c = (prng() % 3 == 0) ? "\r\n--AaB03"[prng() % 9] : (char)('a' + prng() % 26);
+            out[size++] = c;
+            expected[(*expected_size)++] = c;
+        }
+        expected[(*expected_size)++] = '|';
+        size += sprintf(&out[size], "\r\n");
+    }
+    size += sprintf(&out[size], "--AaB03x--\r\n");
+    return size;
+}
+
+bool test_fixed_parse(void)
+{
+    static char body[2000];
+    static char expected[1000];
+    static CollectedParts collected;
+    bool passed = true;
+
+    if (strcmp(minimal_multipart_parser_get_boundary(&(MinimalMultipartParserContext){0}), "AaB03x") != 0)
+    {
+        printf("Case 'fixed parse' (boundary) Failed\n");
+        passed = false;
+    }
+
+    const size_t chunk_sizes[] = {0, 1, 7, 64, sizeof(body)};
+    for (unsigned int round = 0; round < 200; round++)
+    {
+        size_t expected_size = 0;
+        const size_t body_size = build_body(body, expected, &expected_size, round % 2 == 0);
+        for (unsigned int j = 0; j < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); j++)
+        {
+            // A zeroed context is ready to go, and reset gets it ready for the next body
+            MinimalMultipartParserContext context = {0};
+            for (unsigned int body_index = 0; body_index < 2; body_index++)
+            {
+                collected = (CollectedParts){0};
+                test_collect_parts(&context, COLLECT_EVENTS, body, body_size, chunk_sizes[j], &collected);
+                if (collected.count != expected_size || memcmp(collected.out, expected, expected_size) != 0 || !minimal_multipart_parser_is_multipart_completed(&context) ||
+                    minimal_multipart_parser_get_parts_completed(&context) != 2)
+                {
+                    printf("Case 'fixed parse' (round %u, chunk size %zu, body %u) Failed\n", round, chunk_sizes[j], body_index);
+                    passed = false;
+                }
+                minimal_multipart_parser_reset(&context);
+            }
+        }
+    }
+
+    const char haystack[] = "abc--AaB03x\r\n--AaB0\r\n--AaB03x--";
+    MinimalMultipartParserContext context = {0};
+    if (minimal_multipart_parser_find_delimiter(&context, haystack, strlen(haystack)) != 19 || minimal_multipart_parser_find_delimiter(&context, haystack, 20) != 20)
+    {
+        printf("Case 'fixed parse' (find delimiter) Failed\n");
+        passed = false;
+    }
+
+    if (passed)
+    {
+        printf("Case 'fixed parse' Passed\n");
+    }
+    return passed;
+}
+
+bool test_fixed_checkpoint(void)
+{
+    static char body[2000];
+    static char expected[1000];
+    static CollectedParts collected;
+    size_t expected_size = 0;
+    const size_t body_size = build_body(body, expected, &expected_size, true);
+    bool passed = true;
+
+    // Save at every offset, zeroed context included, and carry on in a fresh context
+    for (size_t split = 0; split <= body_size; split++)
+    {
+        MinimalMultipartParserContext context = {0};
+        collected = (CollectedParts){0};
+        test_collect_parts(&context, COLLECT_EVENTS, body, split, 1, &collected);
+
+        unsigned char blob[MINIMAL_MULTIPART_PARSER_CHECKPOINT_MAX_SIZE];
+        const size_t blob_size = minimal_multipart_parser_checkpoint_save(&context, NULL, split, blob, sizeof(blob));
+        MinimalMultipartParserContext restored = {0};
+        unsigned long long offset = 0;
+        if (blob_size == 0 || !minimal_multipart_parser_checkpoint_restore(&restored, NULL, blob, blob_size, &offset) || offset != split)
+        {
+            printf("Case 'fixed checkpoint' (split %zu) Failed to restore\n", split);
+            passed = false;
+            continue;
+        }
+
+        test_collect_parts(&restored, COLLECT_EVENTS, &body[split], body_size - split, 7, &collected);
+        if (collected.count != expected_size || memcmp(collected.out, expected, expected_size) != 0 || !minimal_multipart_parser_is_multipart_completed(&restored))
+        {
+            printf("Case 'fixed checkpoint' (split %zu) Failed\n", split);
+            passed = false;
+        }
+    }
+
+    if (passed)
+    {
+        printf("Case 'fixed checkpoint' Passed\n");
+    }
+    return passed;
+}
+
+int main(int argc, char **argv)
+{
+    printf("Testing Minimal Multipart Form Data Parser (fixed boundary)\n");
+    printf("GCC Version: v%s\n", __VERSION__);
+    printf("Context size: %zu bytes\n", sizeof(MinimalMultipartParserContext));
+
+    if (!test_fixed_parse())
+    {
+        return 1;
+    }
+
+    if (!test_fixed_checkpoint())
+    {
+        return 1;
+    }
+
+    printf("PASSED\n");
+    return 0;
+}
@@ -0,0 +1,205 @@
+//
+// test_spill.c
+//
+// Copyright (c) 2024 Brian Khuu
+// MIT licensed
+//
+
+// Tests for the spill storage companion module, built against the default library layout
+
+#define _GNU_SOURCE
+
+#include "minimal_multipart_spill.h"
+#include "test_support.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Body with two small fields around a file of `file_size` bytes, whose content is written to `file`
+static size_t build_body(char *out, char *file, const size_t file_size)
+{
+    size_t size = 0;
+    size += sprintf(&out[size], "--AaB03x\r\nContent-Disposition: form-data; name=\"title\"\r\n\r\nhello\r\n");
+    size += sprintf(&out[size], "--AaB03x\r\nContent-Disposition: form-data; name=\"upload\"; filename=\"data.bin\"\r\nContent-Type: application/octet-stream\r\n\r\n");
+    for (size_t i = 0; i < file_size; i++)
+    {
+        // Delimiter near misses as well as random bytes
+        file[i] = (prng() % 4 == 0) ? "\r\n--AaB03"[prng() % 9] : (char)prng();
+    }
+    memcpy(&out[size], file, file_size);
+    size += file_size;
+    size += sprintf(&out[size], "\r\n--AaB03x\r\nContent-Disposition: form-data; name=\"tag\"\r\n\r\n\r\n--AaB03x--\r\n");
+    return size;
+}
+
+static size_t feed(MinimalMultipartSpill *spill, const char *body, const size_t body_size, const size_t chunk_size)
+{
+    MinimalMultipartParserContext context = {0};
+    size_t offset = 0;
+    while (offset < body_size)
+    {
+        const size_t remaining = body_size - offset;
+        const size_t chunk = remaining < chunk_size ? remaining : chunk_size;
+        const size_t used = minimal_multipart_parser_process_sink(&context, &spill->sink, &body[offset], chunk);
+        offset += used;
+        if (used < chunk)
+        {
+            break;
+        }
+    }
+    return offset;
+}
+
+static bool part_equals(const MinimalMultipartSpillPart *part, const char *name, const char *data, const size_t size, const bool spilled)
+{
+    if (strcmp(part->name, name) != 0 || part->size != size || !part->complete || (part->fd >= 0) != spilled || (part->data == NULL) != spilled)
+    {
+        return false;
+    }
+    if (!spilled)
+    {
+        return memcmp(part->data, data, size) == 0;
+    }
+
+    char *copy = malloc(size + 1);
+    const bool same = copy && pread(part->fd, copy, size + 1, 0) == (ssize_t)size && memcmp(copy, data, size) == 0;
+    free(copy);
+    return same;
+}
+
+bool test_spill_sizes(void)
+{
+    static char body[300000];
+    static char file[250000];
+    static char arena[64 * 1024];
+    MinimalMultipartSpillPart parts[4];
+    MinimalMultipartSpill spill;
+    minimal_multipart_spill_init(&spill, arena, sizeof(arena), parts, 4, 4096, "/tmp");
+
+    bool passed = true;
+    const size_t file_sizes[] = {0, 100, 4096, 4097, 20000, sizeof(file)};
+    const size_t chunk_sizes[] = {1, 7, 1000, 65536, sizeof(body)};
+    for (unsigned int i = 0; i < sizeof(file_sizes) / sizeof(file_sizes[0]); i++)
+    {
+        const size_t body_size = build_body(body, file, file_sizes[i]);
+        for (unsigned int j = 0; j < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); j++)
+        {
+            // One request after another on the same arena
+            minimal_multipart_spill_reset(&spill);
+            if (chunk_sizes[j] == 1 && file_sizes[i] > 20000)
+            {
+                continue;
+            }
+            const size_t used = feed(&spill, body, body_size, chunk_sizes[j]);
+            const bool spilled = file_sizes[i] > 4096;
+            if (used != body_size || spill.error != 0 || spill.part_count != 3 || !part_equals(&parts[0], "title", "hello", 5, false) ||
+                !part_equals(&parts[1], "upload", file, file_sizes[i], spilled) || strcmp(parts[1].filename, "data.bin") != 0 ||
+                strcmp(parts[1].content_type, "application/octet-stream") != 0 || !part_equals(&parts[2], "tag", "", 0, false) || spill.arena_used > 4096 + 200)
+            {
+                printf("Case 'spill sizes' (%zu byte file, %zu byte chunks) Failed, error %d, %u parts, %zu arena bytes\n", file_sizes[i], chunk_sizes[j], spill.error,
+                       spill.part_count, spill.arena_used);
+                passed = false;
+            }
+        }
+    }
+
+    // Temp files go with the request
+    const int fd = parts[1].fd;
+    minimal_multipart_spill_reset(&spill);
+    if (fd < 0 || fcntl(fd, F_GETFD) != -1 || spill.arena_used != 0 || spill.part_count != 0)
+    {
+        printf("Case 'spill sizes' (reset) Failed\n");
+        passed = false;
+    }
+
+    if (passed)
+    {
+        printf("Case 'spill sizes' Passed\n");
+    }
+    return passed;
+}
+
+bool test_spill_limits(void)
+{
+    static char body[20000];
+    static char file[10000];
+    const size_t body_size = build_body(body, file, 1000);
+    bool passed = true;
+
+    // Arena too small for the file, so it spills however small the threshold says it is
+    char small_arena[600];
+    MinimalMultipartSpillPart parts[4];
+    MinimalMultipartSpill spill;
+    minimal_multipart_spill_init(&spill, small_arena, sizeof(small_arena), parts, 4, 1000000, "/tmp");
+    if (feed(&spill, body, body_size, 64) != body_size || spill.error != 0 || !part_equals(&parts[1], "upload", file, 1000, true) ||
+        !part_equals(&parts[2], "tag", "", 0, false))
+    {
+        printf("Case 'spill limits' (small arena) Failed, error %d\n", spill.error);
+        passed = false;
+    }
+    minimal_multipart_spill_reset(&spill);
+
+    // More parts than places to put them pauses the sink with an error, and the next request starts clean
+    static char arena[4096];
+    minimal_multipart_spill_init(&spill, arena, sizeof(arena), parts, 2, 4096, "/tmp");
+    if (feed(&spill, body, body_size, body_size) == body_size || spill.error != ENOBUFS || spill.part_count != 2)
+    {
+        printf("Case 'spill limits' (part capacity) Failed, error %d\n", spill.error);
+        passed = false;
+    }
+    minimal_multipart_spill_reset(&spill);
+
+    // Request cut short mid file, what was staged still reaches the temp file
+    minimal_multipart_spill_init(&spill, arena, sizeof(arena), parts, 4, 100, "/tmp");
+    const size_t cut = (size_t)(strstr(body, "data.bin") - body) + 300;
+    feed(&spill, body, cut, 7);
+    minimal_multipart_spill_finish(&spill);
+    char copy[1000];
+    const size_t expected = cut - (size_t)(strstr(body, "octet-stream\r\n\r\n") - body) - strlen("octet-stream\r\n\r\n");
+    // Bytes that might be the start of a delimiter are still held back by the parser
+    if (spill.part_count != 2 || parts[1].complete || parts[1].fd < 0 || parts[1].size > expected || parts[1].size + 12 < expected ||
+        pread(parts[1].fd, copy, sizeof(copy), 0) != (ssize_t)parts[1].size || memcmp(copy, file, parts[1].size) != 0)
+    {
+        printf("Case 'spill limits' (cut short) Failed\n");
+        passed = false;
+    }
+    minimal_multipart_spill_reset(&spill);
+
+    // Nowhere to spill to
+    minimal_multipart_spill_init(&spill, arena, sizeof(arena), parts, 4, 100, "/nonexistent/dir");
+    if (feed(&spill, body, body_size, body_size) == body_size || spill.error == 0)
+    {
+        printf("Case 'spill limits' (bad dir) Failed\n");
+        passed = false;
+    }
+    minimal_multipart_spill_reset(&spill);
+
+    if (passed)
+    {
+        printf("Case 'spill limits' Passed\n");
+    }
+    return passed;
+}
+
+int main(int argc, char **argv)
+{
+    printf("Testing Minimal Multipart Spill Storage\n");
+    printf("GCC Version: v%s\n", __VERSION__);
+
+    if (!test_spill_sizes())
+    {
+        return 1;
+    }
+
+    if (!test_spill_limits())
+    {
+        return 1;
+    }
+
+    printf("PASSED\n");
+    return 0;
+}
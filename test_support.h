@@ -0,0 +1,146 @@
+//
+// test_support.h
+//
+// Copyright (c) 2024 Brian Khuu
+// MIT licensed
+//
+
+// Helpers shared by the tests, benchmarks and fuzz harness. Header only, so each program has its own prng state.
+
+#ifndef TEST_SUPPORT_H
+#define TEST_SUPPORT_H
+
+#include "minimal_multipart_parser.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+// Define before including to start prng() from another seed
+#ifndef TEST_SUPPORT_PRNG_SEED
+#define TEST_SUPPORT_PRNG_SEED 12345
+#endif
+
+static unsigned int prng_state = TEST_SUPPORT_PRNG_SEED;
+
+static inline unsigned int prng(void)
+{
+    // xorshift32, so failures can be reproduced from the seed
+    prng_state ^= prng_state << 13;
+    prng_state ^= prng_state >> 17;
+    prng_state ^= prng_state << 5;
+    return prng_state;
+}
+
+// Naive reference: find the first `needle` (e.g. `\r\n--BOUNDARY`) by comparing at every position, or `haystack_size` if none
+static inline size_t naive_find(const char *haystack, const size_t haystack_size, const char *needle, const size_t needle_size)
+{
+    for (size_t i = 0; i + needle_size <= haystack_size; i++)
+    {
+        if (memcmp(&haystack[i], needle, needle_size) == 0)
+        {
+            return i;
+        }
+    }
+    return haystack_size;
+}
+
+// What test_collect_parts() got out of a body. It appends, so zero it to start over
+typedef struct CollectedParts
+{
+    char out[4000]; // Each part's data followed by '|', nul terminated
+    size_t count;
+    char names[200]; // Each part's name followed by '|', nul terminated
+    size_t names_count;
+    bool multipart_completed;
+} CollectedParts;
+
+// Which api test_collect_parts() feeds the body through
+typedef enum
+{
+    COLLECT_EVENTS, // process_buffer() in chunks, or the per char api with a chunk size of 0 (not in the compact build)
+    COLLECT_SINK,   // process_sink() in chunks, with a scratch buffer of a random size up to 7 bytes (0 is no batching)
+} CollectApi;
+
+static inline void collect_name(CollectedParts *collected, const MinimalMultipartParserContext *context)
+{
+    const char *name = minimal_multipart_parser_get_part_name(context);
+    memcpy(&collected->names[collected->names_count], name, strlen(name));
+    collected->names_count += strlen(name);
+    collected->names[collected->names_count++] = '|';
+}
+
+static inline void collect_on_part_begin(void *user_data, const MinimalMultipartParserContext *context) { collect_name(user_data, context); }
+
+static inline void collect_on_data(void *user_data, const char *data, const size_t size)
+{
+    CollectedParts *collected = user_data;
+    memcpy(&collected->out[collected->count], data, size);
+    collected->count += size;
+}
+
+static inline void collect_on_part_end(void *user_data, const MinimalMultipartParserContext *context)
+{
+    CollectedParts *collected = user_data;
+    collected->out[collected->count++] = '|';
+}
+
+// Feed `input` to an already set up context and collect every part of it. Returns how many data bytes this call added
+static inline size_t test_collect_parts(MinimalMultipartParserContext *context, const CollectApi api, const char *input, const size_t input_size, const size_t chunk_size, CollectedParts *collected)
+{
+    const size_t start = collected->count;
+    if (api == COLLECT_SINK)
+    {
+        char scratch[8];
+        MinimalMultipartParserSink sink = {collect_on_part_begin, collect_on_data, collect_on_part_end, collected, scratch, prng() % sizeof(scratch), 0};
+        for (size_t offset = 0; offset < input_size;)
+        {
+            const size_t chunk = (input_size - offset) < chunk_size ? (input_size - offset) : chunk_size;
+            offset += minimal_multipart_parser_process_sink(context, &sink, &input[offset], chunk);
+        }
+        // Nothing left over if the body completed, but a cut short one may stop mid part
+        minimal_multipart_parser_sink_flush(&sink);
+        collected->multipart_completed |= minimal_multipart_parser_is_multipart_completed(context);
+    }
+    else
+    {
+        for (size_t offset = 0; offset < input_size;)
+        {
+            MultipartParserEvent event;
+#ifndef MINIMAL_MULTIPART_PARSER_COMPACT_CONTEXT
+            if (chunk_size == 0)
+            {
+                event = minimal_multipart_parser_process(context, input[offset++]);
+            }
+            else
+#endif
+            {
+                const size_t remaining = input_size - offset;
+                size_t consumed = 0;
+                event = minimal_multipart_parser_process_buffer(context, &input[offset], remaining < chunk_size ? remaining : chunk_size, &consumed);
+                offset += consumed;
+            }
+
+            if (event == MultipartParserEvent_FileStreamStarting)
+            {
+                collect_name(collected, context);
+            }
+            else if (event == MultipartParserEvent_DataBufferAvailable)
+            {
+                collect_on_data(collected, minimal_multipart_parser_get_data_buffer(context), minimal_multipart_parser_get_data_size(context));
+            }
+            else if (event == MultipartParserEvent_DataStreamCompleted)
+            {
+                collected->out[collected->count++] = '|';
+            }
+            else if (event == MultipartParserEvent_MultipartStreamCompleted)
+            {
+                collected->multipart_completed = true;
+            }
+        }
+    }
+    collected->out[collected->count] = '\0';
+    collected->names[collected->names_count] = '\0';
+    return collected->count - start;
+}
+
+#endif